@@ -0,0 +1,224 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "Ascii.h"
+
+namespace HSLL
+{
+#if defined(__x86_64__) || defined(__i386__)
+    struct ScanSSE2
+    {
+        static constexpr size_t width = 16;
+
+        static inline unsigned int Mask(const char *p, char c)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+        }
+
+        static inline void Copy(char *dst, const char *src)
+        {
+            _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        }
+    };
+#endif
+
+    struct ScanScalar
+    {
+        static constexpr size_t width = 0; //!< No vector loop, everything goes through the byte loop
+
+        static inline unsigned int Mask(const char *, char) { return 0; }
+        static inline void Copy(char *, const char *) {}
+    };
+
+    template <class Scan>
+    static inline size_t ToNetKernel(const char *in, size_t len, char *out, bool &cr)
+    {
+        size_t i = 0, o = 0;
+        bool prev = cr;
+
+        for (; Scan::width && i + Scan::width <= len; i += Scan::width)
+        {
+            unsigned int mask = Scan::Mask(in + i, '\n');
+            if (mask == 0)
+            {
+                Scan::Copy(out + o, in + i);
+                o += Scan::width;
+            }
+            else
+            {
+                // Each piece is copied with one full vector store that the next store overwrites; the output
+                // holds 2 * len bytes, so this stays in bounds wherever a whole vector of input follows
+                size_t start = 0;
+                bool room = (i + 2 * Scan::width <= len);
+                while (mask)
+                {
+                    size_t bit = (size_t)__builtin_ctz(mask);
+                    if (room)
+                        Scan::Copy(out + o, in + i + start);
+                    else
+                        memcpy(out + o, in + i + start, bit - start);
+                    o += bit - start;
+
+                    if (!(bit ? in[i + bit - 1] == '\r' : prev))
+                        out[o++] = '\r';
+                    out[o++] = '\n';
+
+                    start = bit + 1;
+                    mask &= mask - 1;
+                }
+                if (room)
+                    Scan::Copy(out + o, in + i + start);
+                else
+                    memcpy(out + o, in + i + start, Scan::width - start);
+                o += Scan::width - start;
+            }
+            prev = (in[i + Scan::width - 1] == '\r');
+        }
+
+        for (; i < len; ++i)
+        {
+            if (in[i] == '\n' && !prev)
+                out[o++] = '\r';
+            out[o++] = in[i];
+            prev = (in[i] == '\r');
+        }
+
+        cr = prev;
+        return o;
+    }
+
+    template <class Scan>
+    static inline size_t FromNetKernel(const char *in, size_t len, char *out, bool &cr, bool last)
+    {
+        size_t i = 0, o = 0;
+
+        // A CR held back from the previous chunk is dropped only if this chunk starts with its LF
+        if (cr && len)
+        {
+            if (in[0] != '\n')
+                out[o++] = '\r';
+            cr = false;
+        }
+
+        for (; Scan::width && i + Scan::width <= len; i += Scan::width)
+        {
+            unsigned int mask = Scan::Mask(in + i, '\r');
+            if (mask == 0)
+            {
+                Scan::Copy(out + o, in + i);
+                o += Scan::width;
+                continue;
+            }
+
+            // Same vector stores as ToNet; the output never runs ahead of the input
+            size_t start = 0;
+            bool room = (i + 2 * Scan::width <= len);
+            while (mask)
+            {
+                size_t bit = (size_t)__builtin_ctz(mask);
+                if (room)
+                    Scan::Copy(out + o, in + i + start);
+                else
+                    memcpy(out + o, in + i + start, bit - start);
+                o += bit - start;
+
+                if (i + bit + 1 == len)
+                    cr = true;
+                else if (in[i + bit + 1] != '\n')
+                    out[o++] = '\r';
+
+                start = bit + 1;
+                mask &= mask - 1;
+            }
+            if (room)
+                Scan::Copy(out + o, in + i + start);
+            else
+                memcpy(out + o, in + i + start, Scan::width - start);
+            o += Scan::width - start;
+        }
+
+        for (; i < len; ++i)
+        {
+            if (in[i] != '\r')
+                out[o++] = in[i];
+            else if (i + 1 == len)
+                cr = true;
+            else if (in[i + 1] != '\n')
+                out[o++] = '\r';
+        }
+
+        if (last && cr)
+        {
+            out[o++] = '\r';
+            cr = false;
+        }
+        return o;
+    }
+
+    static size_t ToNetScalar(const char *in, size_t len, char *out, bool &cr)
+    {
+        return ToNetKernel<ScanScalar>(in, len, out, cr);
+    }
+
+    static size_t FromNetScalar(const char *in, size_t len, char *out, bool &cr, bool last)
+    {
+        return FromNetKernel<ScanScalar>(in, len, out, cr, last);
+    }
+
+    typedef size_t (*ToNetProc)(const char *in, size_t len, char *out, bool &cr);
+    typedef size_t (*FromNetProc)(const char *in, size_t len, char *out, bool &cr, bool last);
+
+#if defined(__x86_64__) || defined(__i386__)
+    static size_t ToNetSSE2(const char *in, size_t len, char *out, bool &cr)
+    {
+        return ToNetKernel<ScanSSE2>(in, len, out, cr);
+    }
+
+    static size_t FromNetSSE2(const char *in, size_t len, char *out, bool &cr, bool last)
+    {
+        return FromNetKernel<ScanSSE2>(in, len, out, cr, last);
+    }
+
+    static ToNetProc toNet = ToNetSSE2;
+    static FromNetProc fromNet = FromNetSSE2;
+#else
+    static ToNetProc toNet = ToNetScalar;
+    static FromNetProc fromNet = FromNetScalar;
+#endif
+
+    bool Ascii::Select(ASCII_KERNEL kernel)
+    {
+        switch (kernel)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+        case ASCII_KERNEL_AUTO:
+        case ASCII_KERNEL_SSE2:
+            toNet = ToNetSSE2;
+            fromNet = FromNetSSE2;
+            return true;
+#else
+        case ASCII_KERNEL_AUTO:
+#endif
+        case ASCII_KERNEL_SCALAR:
+            toNet = ToNetScalar;
+            fromNet = FromNetScalar;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    size_t Ascii::ToNet(const char *in, size_t len, char *out, bool &cr)
+    {
+        return toNet(in, len, out, cr);
+    }
+
+    size_t Ascii::FromNet(const char *in, size_t len, char *out, bool &cr, bool last)
+    {
+        return fromNet(in, len, out, cr, last);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef HSLL_ASCII
+#define HSLL_ASCII
+
+#include <cstddef>
+
+namespace HSLL
+{
+    /**
+     * @brief Conversion kernels of Ascii
+     */
+    enum ASCII_KERNEL
+    {
+        ASCII_KERNEL_AUTO,  //!< SSE2 on x86, scalar elsewhere
+        ASCII_KERNEL_SSE2,  //!< 16-byte vectors
+        ASCII_KERNEL_SCALAR //!< Byte loop
+    };
+
+    /**
+     * @brief TYPE A line ending conversion
+     * @details Converts between local LF and network CRLF line endings. Input is scanned 16 bytes at a time
+     *          with SSE2 (scalar on other architectures); the text between line endings is moved with whole
+     *          vector stores, which is why the output must not overlap the input. A CR at the end of a
+     *          chunk is carried to the next call, so the conversion is independent of how data is split
+     */
+    class Ascii
+    {
+    public:
+        /**
+         * @brief Choose the conversion kernel
+         * @details The server keeps the automatic choice; other kernels are selected by the benchmark
+         * @param kernel Kernel to use
+         * @return false if the CPU does not support the kernel (the current one is kept)
+         */
+        static bool Select(ASCII_KERNEL kernel);
+
+        /**
+         * @brief Convert LF to CRLF (RETR)
+         * @param in Local data
+         * @param len Input length
+         * @param out Output buffer of at least 2 * len bytes, not overlapping in
+         * @param cr In/out: whether the last byte of the previous chunk was CR
+         * @return Output length
+         * @note An LF already preceded by CR is left alone
+         */
+        static size_t ToNet(const char *in, size_t len, char *out, bool &cr);
+
+        /**
+         * @brief Convert CRLF to LF (STOR)
+         * @param in Network data
+         * @param len Input length
+         * @param out Output buffer of at least len + 1 bytes, not overlapping in
+         * @param cr In/out: whether a CR ending the previous chunk is still held back
+         * @param last Whether this is the final chunk (a held CR is then written out)
+         * @return Output length
+         */
+        static size_t FromNet(const char *in, size_t len, char *out, bool &cr, bool last);
+    };
+}
+
+#endif
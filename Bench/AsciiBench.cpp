@@ -0,0 +1,184 @@
+/**
+ * @file AsciiBench.cpp
+ * @brief TYPE A conversion benchmark
+ * @details Checks every kernel against a byte-wise reference on random data split at random chunk
+ *          boundaries, then times ToNet and FromNet per kernel on text split into transfer-sized blocks
+ *          and reports the throughput in GB/s
+ */
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "../Ascii/Ascii.h"
+
+using namespace HSLL;
+
+/**
+ * @brief Rounds of the equivalence check per kernel
+ */
+#define HSLL_BENCH_ROUNDS 2000
+
+/**
+ * @brief Bytes converted per timed run
+ */
+#define HSLL_BENCH_BYTES (512 * 1024 * 1024)
+
+struct Kernel
+{
+    ASCII_KERNEL kernel; //!< Kernel selected in Ascii
+    const char *name;    //!< Name printed in the report
+};
+
+static const Kernel kernels[] = {{ASCII_KERNEL_SSE2, "sse2"}, {ASCII_KERNEL_SCALAR, "scalar"}};
+
+/**
+ * @brief LF to CRLF of a whole stream, one byte at a time
+ */
+static std::string RefToNet(const std::string &in)
+{
+    std::string out;
+    bool cr = false;
+    for (char c : in)
+    {
+        if (c == '\n' && !cr)
+            out.push_back('\r');
+        out.push_back(c);
+        cr = (c == '\r');
+    }
+    return out;
+}
+
+/**
+ * @brief CRLF to LF of a whole stream, one byte at a time
+ */
+static std::string RefFromNet(const std::string &in)
+{
+    std::string out;
+    for (size_t i = 0; i < in.size(); ++i)
+    {
+        if (in[i] == '\r' && i + 1 < in.size() && in[i + 1] == '\n')
+            continue;
+        out.push_back(in[i]);
+    }
+    return out;
+}
+
+/**
+ * @brief Random data rich in CR, LF and CRLF, so line endings land on every vector and chunk position
+ */
+static std::string RandomData(std::mt19937 &rng, size_t length)
+{
+    static const char alphabet[] = {'a', 'b', ' ', '\r', '\n', '\n'};
+    std::uniform_int_distribution<int> dense(0, sizeof(alphabet) - 1);
+    std::uniform_int_distribution<int> sparse(0, 63);
+    bool rich = rng() & 1;
+
+    std::string data(length, 'x');
+    for (char &c : data)
+        c = rich ? alphabet[dense(rng)] : (sparse(rng) == 0 ? '\n' : (char)('a' + sparse(rng) % 26));
+    return data;
+}
+
+/**
+ * @brief Split data into random chunks and compare the converted stream with the reference
+ */
+static bool Check(std::mt19937 &rng)
+{
+    std::uniform_int_distribution<size_t> lengths(0, 4096);
+    std::uniform_int_distribution<size_t> chunks(1, 300);
+    std::string data = RandomData(rng, lengths(rng));
+    std::vector<char> out(2 * data.size() + 1);
+    std::string toNet, fromNet;
+    bool toCr = false, fromCr = false;
+
+    for (size_t i = 0; i <= data.size();)
+    {
+        size_t n = std::min(chunks(rng) % 8 == 0 ? 0 : chunks(rng), data.size() - i);
+        bool last = (i + n == data.size());
+
+        toNet.append(out.data(), Ascii::ToNet(data.data() + i, n, out.data(), toCr));
+        fromNet.append(out.data(), Ascii::FromNet(data.data() + i, n, out.data(), fromCr, last));
+
+        i += n;
+        if (last)
+            break;
+    }
+
+    return toNet == RefToNet(data) && fromNet == RefFromNet(data);
+}
+
+/**
+ * @brief Convert HSLL_BENCH_BYTES of text block by block
+ * @return Throughput in GB/s of input
+ */
+static double Time(const std::string &text, size_t block, bool toNet)
+{
+    std::vector<char> out(2 * block + 1);
+    size_t rounds = HSLL_BENCH_BYTES / text.size();
+    size_t sink = 0;
+    bool cr = false;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (size_t i = 0; i < text.size(); i += block)
+        {
+            size_t n = std::min(block, text.size() - i);
+            sink += toNet ? Ascii::ToNet(text.data() + i, n, out.data(), cr)
+                          : Ascii::FromNet(text.data() + i, n, out.data(), cr, false);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (sink == 0)
+        printf("no output\n");
+    return (double)rounds * text.size() / seconds / 1e9;
+}
+
+int main()
+{
+    std::mt19937 rng(20260101);
+    bool ok = true;
+
+    for (const Kernel &k : kernels)
+    {
+        if (!Ascii::Select(k.kernel))
+        {
+            printf("%-7s unsupported\n", k.name);
+            continue;
+        }
+
+        int failed = 0;
+        for (int r = 0; r < HSLL_BENCH_ROUNDS; ++r)
+            failed += !Check(rng);
+        printf("%-7s equivalence: %s\n", k.name, failed ? "FAILED" : "ok");
+        ok = ok && failed == 0;
+    }
+
+    // Source-like text: lines of 20 to 100 characters
+    std::string local, net;
+    std::uniform_int_distribution<int> widths(20, 100);
+    while (local.size() < 16 * 1024 * 1024)
+    {
+        std::string line(widths(rng), 'a');
+        for (char &c : line)
+            c = (char)('a' + rng() % 26);
+        local += line + "\n";
+        net += line + "\r\n";
+    }
+
+    printf("\n%-7s %8s %10s %10s\n", "kernel", "block", "ToNet", "FromNet");
+    for (const Kernel &k : kernels)
+    {
+        if (!Ascii::Select(k.kernel))
+            continue;
+
+        for (size_t block : {16 * 1024, 256 * 1024, 1024 * 1024})
+            printf("%-7s %7zuK %5.2f GB/s %5.2f GB/s\n", k.name, block / 1024, Time(local, block, true), Time(net, block, false));
+    }
+
+    Ascii::Select(ASCII_KERNEL_AUTO);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <sys/mman.h>
+
+#include "BufferPool.h"
+
+namespace HSLL
+{
+    bool BufferPool::huge = false;
+    std::mutex BufferPool::mtx;
+    std::vector<char *> BufferPool::idle[HSLL_BUFFER_CLASSES];
+    std::vector<std::pair<void *, size_t>> BufferPool::regions;
+
+    /**
+     * @brief Per-thread cache of free buffers
+     * @details Hands its buffers back to the shared lists when the thread exits
+     */
+    struct BufferCache
+    {
+        bool open = true;                              //!< Cleared while the thread is exiting
+        std::vector<char *> idle[HSLL_BUFFER_CLASSES]; //!< Cached buffers of each class
+
+        ~BufferCache()
+        {
+            open = false;
+            for (unsigned int i = 0; i < HSLL_BUFFER_CLASSES; ++i)
+            {
+                for (char *buffer : idle[i])
+                    BufferPool::Recycle(buffer, (size_t)HSLL_BUFFER_MIN << (2 * i));
+            }
+        }
+    };
+
+    static thread_local BufferCache cache;
+
+    char *BufferPool::Map(size_t size)
+    {
+        void *addr = MAP_FAILED;
+
+        if (huge)
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (addr == MAP_FAILED)
+        {
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (addr == MAP_FAILED)
+                return nullptr;
+
+            if (huge)
+                madvise(addr, size, MADV_HUGEPAGE);
+        }
+
+        regions.emplace_back(addr, size);
+        return (char *)addr;
+    }
+
+    unsigned int BufferPool::Class(size_t size)
+    {
+        unsigned int index = 0;
+        while (index + 1 < HSLL_BUFFER_CLASSES && ((size_t)HSLL_BUFFER_MIN << (2 * index)) < size)
+            ++index;
+        return index;
+    }
+
+    void BufferPool::Init(bool huge)
+    {
+        BufferPool::huge = huge;
+    }
+
+    void BufferPool::Release()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        for (auto &region : regions)
+            munmap(region.first, region.second);
+
+        regions.clear();
+        for (unsigned int i = 0; i < HSLL_BUFFER_CLASSES; ++i)
+            idle[i].clear();
+    }
+
+    char *BufferPool::Acquire(size_t &size)
+    {
+        if (size > HSLL_BUFFER_MAX)
+            return nullptr;
+
+        unsigned int index = Class(size);
+        size = (size_t)HSLL_BUFFER_MIN << (2 * index);
+
+        if (cache.open && !cache.idle[index].empty())
+        {
+            char *buffer = cache.idle[index].back();
+            cache.idle[index].pop_back();
+            return buffer;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (idle[index].empty())
+        {
+            // Small classes are carved from one slab so they share its huge page
+            size_t span = std::max(size, (size_t)HSLL_BUFFER_SLAB);
+            char *region = Map(span);
+            if (region == nullptr)
+                return nullptr;
+
+            for (size_t off = span; off >= size; off -= size)
+                idle[index].push_back(region + off - size);
+        }
+
+        char *buffer = idle[index].back();
+        idle[index].pop_back();
+        return buffer;
+    }
+
+    void BufferPool::Recycle(char *buffer, size_t size)
+    {
+        unsigned int index = Class(size);
+
+        if (cache.open && cache.idle[index].size() < HSLL_BUFFER_CACHE)
+        {
+            cache.idle[index].push_back(buffer);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!regions.empty())
+            idle[index].push_back(buffer);
+    }
+
+    size_t BufferPool::SizeFor(double bytesPerSecond)
+    {
+        double want = bytesPerSecond / 50;
+        size_t size = HSLL_BUFFER_MIN;
+        while (size < HSLL_BUFFER_MAX && (double)size < want)
+            size <<= 2;
+        return size;
+    }
+}
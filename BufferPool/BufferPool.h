@@ -0,0 +1,101 @@
+#ifndef HSLL_BUFFERPOOL
+#define HSLL_BUFFERPOOL
+
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Number of buffer size classes (64 KB, 256 KB, 1 MB, 4 MB)
+ */
+#define HSLL_BUFFER_CLASSES 4
+
+/**
+ * @brief Smallest buffer size class
+ */
+#define HSLL_BUFFER_MIN (64 * 1024)
+
+/**
+ * @brief Largest buffer size class
+ */
+#define HSLL_BUFFER_MAX (4 * 1024 * 1024)
+
+/**
+ * @brief Size of the slabs smaller classes are carved from (one huge page)
+ */
+#define HSLL_BUFFER_SLAB (2 * 1024 * 1024)
+
+/**
+ * @brief Maximum number of buffers of each class kept in a thread's cache
+ */
+#define HSLL_BUFFER_CACHE 4
+
+namespace HSLL
+{
+    /**
+     * @brief Shared transfer buffer pool
+     * @details Buffers come in power-of-four size classes. Classes below the slab size are carved from
+     *          2 MB slabs, larger ones are mapped individually; with huge pages enabled the mappings use
+     *          MAP_HUGETLB when reserved pages exist and transparent huge pages otherwise. Freed buffers go
+     *          to a small per-thread cache first and to the shared free lists when it is full. Memory is
+     *          only returned to the system by Release()
+     */
+    class BufferPool
+    {
+    private:
+        static bool huge;                                              //!< Whether mappings try to use huge pages
+        static std::mutex mtx;                                         //!< Protects the shared free lists
+        static std::vector<char *> idle[HSLL_BUFFER_CLASSES];          //!< Shared free buffers of each class
+        static std::vector<std::pair<void *, size_t>> regions;         //!< Every mapping, for Release()
+
+        /**
+         * @brief Map a region, preferring huge pages when enabled
+         * @param size Region size (multiple of the slab size)
+         * @return Region address, or nullptr on failure
+         */
+        static char *Map(size_t size);
+
+        /**
+         * @brief Get the size class of a buffer size
+         * @param size Buffer size
+         * @return Class index
+         */
+        static unsigned int Class(size_t size);
+
+    public:
+        /**
+         * @brief Configure the pool
+         * @param huge Whether buffers should be backed by huge pages
+         */
+        static void Init(bool huge);
+
+        /**
+         * @brief Unmap all memory
+         * @note No buffer may be in use
+         */
+        static void Release();
+
+        /**
+         * @brief Borrow a buffer
+         * @param size In: requested size, out: size of the buffer returned (rounded up to its class)
+         * @return Buffer, or nullptr if the size exceeds the largest class or memory is exhausted
+         */
+        static char *Acquire(size_t &size);
+
+        /**
+         * @brief Return a buffer
+         * @param buffer Buffer obtained from Acquire()
+         * @param size Size returned by Acquire()
+         */
+        static void Recycle(char *buffer, size_t size);
+
+        /**
+         * @brief Choose a buffer size for a transfer rate
+         * @param bytesPerSecond Observed rate of the connection
+         * @return Buffer size holding roughly 20 ms of data, clamped to the size classes
+         */
+        static size_t SizeFor(double bytesPerSecond);
+    };
+}
+
+#endif
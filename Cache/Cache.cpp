@@ -0,0 +1,111 @@
+#include "Cache.h"
+#include <fcntl.h>
+#include <algorithm>
+
+namespace HSLL
+{
+    off_t CachePolicy::dropSize = 0;
+    std::atomic<unsigned long long> CachePolicy::prefetched{0};
+    std::atomic<unsigned long long> CachePolicy::dropped{0};
+
+    CachePolicy::CachePolicy() : fd(-1), writing(false), drop(false), first(0), end(-1),
+                                 fetched(0), flushed(0), released(0)
+    {
+    }
+
+    void CachePolicy::Init(off_t dropSize)
+    {
+        CachePolicy::dropSize = dropSize;
+    }
+
+    unsigned long long CachePolicy::Prefetched()
+    {
+        return prefetched.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long CachePolicy::Dropped()
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void CachePolicy::Prefetch(int fd, off_t length)
+    {
+        if (length > 0 && readahead(fd, 0, (size_t)length) == 0)
+            prefetched.fetch_add((unsigned long long)length, std::memory_order_relaxed);
+    }
+
+    void CachePolicy::Open(int fd, off_t offset, off_t size, bool writing)
+    {
+        this->fd = fd;
+        this->writing = writing;
+        first = fetched = flushed = released = offset;
+        end = size;
+        drop = dropSize && size >= dropSize;
+
+        if (!writing)
+        {
+            posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+            Advance(offset);
+        }
+    }
+
+    void CachePolicy::Release(off_t position)
+    {
+        if (position <= released)
+            return;
+
+        if (posix_fadvise(fd, released, position - released, POSIX_FADV_DONTNEED) == 0)
+            dropped.fetch_add((unsigned long long)(position - released), std::memory_order_relaxed);
+        released = position;
+    }
+
+    void CachePolicy::Advance(off_t position)
+    {
+        if (fd == -1)
+            return;
+
+        if (!writing)
+        {
+            // Top the prefetched range up to two windows once less than one is left ahead of the cursor
+            if (fetched < end && fetched < position + HSLL_CACHE_WINDOW)
+            {
+                off_t target = std::min(end, position + 2 * (off_t)HSLL_CACHE_WINDOW);
+                if (readahead(fd, fetched, (size_t)(target - fetched)) == 0)
+                    prefetched.fetch_add((unsigned long long)(target - fetched), std::memory_order_relaxed);
+                fetched = target;
+            }
+
+            if (drop && position - released >= HSLL_CACHE_WINDOW)
+                Release(position);
+            return;
+        }
+
+        // An upload of unknown size is dropped once it has grown past the drop size
+        if (!drop && dropSize && end < 0 && position - first >= dropSize)
+            drop = true;
+
+        if (!drop || position - flushed < HSLL_CACHE_WINDOW)
+            return;
+
+        // Start writeback of the new window and evict the previous one, whose writeback was started a window
+        // ago; the session never waits on the disk, pages still being written are left for the kernel to reclaim
+        sync_file_range(fd, flushed, position - flushed, SYNC_FILE_RANGE_WRITE);
+        Release(flushed);
+        flushed = position;
+    }
+
+    void CachePolicy::Finish(off_t position)
+    {
+        if (fd == -1)
+            return;
+
+        if (drop)
+        {
+            if (writing && position > flushed)
+                sync_file_range(fd, flushed, position - flushed, SYNC_FILE_RANGE_WRITE);
+            else if (!writing)
+                Release(position);
+        }
+        fd = -1;
+    }
+}
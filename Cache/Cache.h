@@ -0,0 +1,92 @@
+#ifndef HSLL_CACHE
+#define HSLL_CACHE
+
+#include <atomic>
+#include <sys/types.h>
+
+/**
+ * @brief Readahead window and write-behind step of a streaming transfer
+ */
+#define HSLL_CACHE_WINDOW (4 * 1024 * 1024)
+
+namespace HSLL
+{
+    /**
+     * @brief Page-cache policy of one file transfer
+     * @details Downloads are announced as sequential and prefetched up to two windows ahead of the cursor.
+     *          Transfers of files at least the drop size evict their pages behind the cursor: uploads start
+     *          writeback (sync_file_range) one window at a time and drop the previous window without waiting
+     *          for it; pages still under writeback are left for the kernel to reclaim. One-shot transfers of
+     *          huge files therefore no longer push hot small files out of the page cache
+     */
+    class CachePolicy
+    {
+    private:
+        static off_t dropSize;                             //!< Transfers of files this large are dropped, 0 for never
+        static std::atomic<unsigned long long> prefetched; //!< Bytes requested by readahead
+        static std::atomic<unsigned long long> dropped;    //!< Bytes evicted behind transfers
+
+        int fd;         //!< File of the transfer, -1 when idle
+        bool writing;   //!< Upload (write-behind) instead of download
+        bool drop;      //!< Evict pages behind the cursor
+        off_t first;    //!< First byte of the transfer
+        off_t end;      //!< End of the file (download) or announced size (upload), -1 if unknown
+        off_t fetched;  //!< End of the prefetched range
+        off_t flushed;  //!< End of the range whose writeback was started
+        off_t released; //!< End of the range dropped from the cache
+
+        /**
+         * @brief Evict a range and account for it
+         */
+        void Release(off_t position);
+
+    public:
+        CachePolicy();
+
+        /**
+         * @brief Set the size from which transfers are dropped from the page cache
+         * @param dropSize Size in bytes, 0 to keep every file cached
+         */
+        static void Init(off_t dropSize);
+
+        /**
+         * @brief Get the number of bytes requested by readahead since startup
+         */
+        static unsigned long long Prefetched();
+
+        /**
+         * @brief Get the number of bytes evicted behind transfers since startup
+         */
+        static unsigned long long Dropped();
+
+        /**
+         * @brief Prefetch the head of a file that is likely to be downloaded next
+         * @param fd Open file
+         * @param length Bytes from the start of the file
+         */
+        static void Prefetch(int fd, off_t length);
+
+        /**
+         * @brief Start the policy of a transfer
+         * @param fd Open file
+         * @param offset First byte transferred
+         * @param size File size (download) or announced size (upload), -1 if unknown
+         * @param writing Whether data is written to the file
+         */
+        void Open(int fd, off_t offset, off_t size, bool writing);
+
+        /**
+         * @brief Move the transfer cursor
+         * @param position File position up to which data has been read or written
+         */
+        void Advance(off_t position);
+
+        /**
+         * @brief End the transfer, dropping what was read and starting writeback of the tail
+         * @param position Final file position
+         */
+        void Finish(off_t position);
+    };
+}
+
+#endif
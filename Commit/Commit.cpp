@@ -0,0 +1,264 @@
+#include "Commit.h"
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <climits>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+namespace HSLL
+{
+    COMMIT_MODE GroupCommit::mode = COMMIT_MODE_NONE;
+    unsigned int GroupCommit::window = 0;
+    int GroupCommit::eventFd = -1;
+    CompleteProc GroupCommit::cp = nullptr;
+    EVWatcher *GroupCommit::watcher = nullptr;
+    std::thread GroupCommit::flusher;
+    std::mutex GroupCommit::mtx;
+    std::condition_variable GroupCommit::queueCv;
+    std::condition_variable GroupCommit::serveCv;
+    std::vector<URingRequest *> GroupCommit::queued;
+    std::vector<URingRequest *> GroupCommit::flushing;
+    std::vector<URingRequest *> GroupCommit::served;
+    bool GroupCommit::stopping = false;
+
+    /**
+     * @brief Get the directory holding an open file
+     * @return Directory path, empty if fd is a directory or its path is unknown
+     */
+    static std::string ParentOf(int fd)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode))
+            return "";
+
+        char path[PATH_MAX];
+        ssize_t len = readlink(("/proc/self/fd/" + std::to_string(fd)).c_str(), path, sizeof(path) - 1);
+        if (len <= 0 || path[0] != '/')
+            return "";
+
+        std::string file(path, (size_t)len);
+        size_t index = file.find_last_of('/');
+        return index ? file.substr(0, index) : "/";
+    }
+
+    bool GroupCommit::Init(COMMIT_MODE mode, unsigned int window, CompleteProc cp)
+    {
+        if (mode == COMMIT_MODE_NONE)
+            return true;
+
+        if (eventFd != -1 || cp == nullptr)
+            return false;
+
+        GroupCommit::window = window;
+        GroupCommit::cp = cp;
+
+        if ((eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            goto exitFalse;
+
+        watcher = new EVWatcher(Callback_Complete, nullptr);
+        if (watcher->Watch(eventFd, EV_READ | EV_PERSIST, 0) != 0)
+            goto exitFalse;
+
+        GroupCommit::mode = mode;
+        stopping = false;
+        flusher = std::thread(Flush);
+
+        HSLL_LOGINFO(LOG_LEVEL_INFO, "Group commit enabled, mode: ", (mode == COMMIT_MODE_SYNCFS) ? "syncfs" : "fdatasync",
+                     ", window: ", window, " ms")
+        return true;
+
+    exitFalse:
+        Release();
+        return false;
+    }
+
+    void GroupCommit::Release()
+    {
+        if (flusher.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            queueCv.notify_all();
+            flusher.join();
+            queued.clear();
+            served.clear();
+        }
+
+        if (watcher)
+        {
+            delete watcher;
+            watcher = nullptr;
+        }
+
+        if (eventFd != -1)
+        {
+            close(eventFd);
+            eventFd = -1;
+        }
+
+        mode = COMMIT_MODE_NONE;
+    }
+
+    bool GroupCommit::Enabled()
+    {
+        return mode != COMMIT_MODE_NONE;
+    }
+
+    int GroupCommit::Sync(URingRequest &req, int fd)
+    {
+        int state = req.state.load(std::memory_order_acquire);
+
+        if (state == URING_STATE_DONE)
+        {
+            req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+            if (req.result < 0)
+            {
+                errno = -req.result;
+                return -1;
+            }
+            return 0;
+        }
+
+        if (state == URING_STATE_IDLE)
+        {
+            req.opcode = IORING_OP_FSYNC;
+            req.fd = fd;
+            req.result = 0;
+            req.state.store(URING_STATE_INFLIGHT, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                queued.push_back(&req);
+            }
+            queueCv.notify_one();
+        }
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    void GroupCommit::Cancel(URingRequest &req)
+    {
+        if (req.opcode != IORING_OP_FSYNC || req.state.load(std::memory_order_acquire) != URING_STATE_INFLIGHT)
+            return;
+
+        // A queued ticket is simply dropped; one being flushed is waited for, the flush holds its descriptor
+        std::unique_lock<std::mutex> lock(mtx);
+        auto it = std::find(queued.begin(), queued.end(), &req);
+        if (it != queued.end())
+        {
+            queued.erase(it);
+        }
+        else
+        {
+            serveCv.wait(lock, [&req]
+                         { return std::find(served.begin(), served.end(), &req) != served.end(); });
+            served.erase(std::find(served.begin(), served.end(), &req));
+        }
+
+        req.ctx = nullptr;
+        req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+    }
+
+    void GroupCommit::Flush()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        while (true)
+        {
+            queueCv.wait(lock, []
+                         { return stopping || !queued.empty(); });
+            if (queued.empty())
+                return;
+
+            // Uploads finishing shortly after the first one join its batch
+            if (window)
+                queueCv.wait_for(lock, std::chrono::milliseconds(window), []
+                                 { return stopping; });
+            if (queued.empty())
+                continue;
+
+            flushing.swap(queued);
+            lock.unlock();
+
+            if (mode == COMMIT_MODE_SYNCFS)
+            {
+                // One syncfs per file system covers every file of the batch stored on it
+                std::vector<std::pair<dev_t, int>> devices;
+                for (URingRequest *req : flushing)
+                {
+                    struct stat st;
+                    if (fstat(req->fd, &st) != 0)
+                    {
+                        req->result = -errno;
+                        continue;
+                    }
+
+                    auto it = std::find_if(devices.begin(), devices.end(), [&st](const std::pair<dev_t, int> &device)
+                                           { return device.first == st.st_dev; });
+                    if (it == devices.end())
+                        it = devices.insert(devices.end(), {st.st_dev, (syncfs(req->fd) == 0) ? 0 : -errno});
+                    req->result = it->second;
+                }
+            }
+            else
+            {
+                // Writeback of the whole batch is started first, so the flushes below wait on I/O issued together
+                for (URingRequest *req : flushing)
+                    sync_file_range(req->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+
+                for (URingRequest *req : flushing)
+                    req->result = (fdatasync(req->fd) == 0) ? 0 : -errno;
+
+                // New names only persist once their directory is flushed; each directory is flushed once per batch
+                std::vector<std::pair<std::string, int>> dirs;
+                for (URingRequest *req : flushing)
+                {
+                    std::string dir = ParentOf(req->fd);
+                    if (req->result != 0 || dir.empty())
+                        continue;
+
+                    auto it = std::find_if(dirs.begin(), dirs.end(), [&dir](const std::pair<std::string, int> &entry)
+                                           { return entry.first == dir; });
+                    if (it == dirs.end())
+                    {
+                        int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                        int result = (dirFd >= 0 && fsync(dirFd) == 0) ? 0 : -errno;
+                        if (dirFd >= 0)
+                            close(dirFd);
+                        it = dirs.insert(dirs.end(), {dir, result});
+                    }
+                    req->result = it->second;
+                }
+            }
+
+            lock.lock();
+            served.insert(served.end(), flushing.begin(), flushing.end());
+            flushing.clear();
+            serveCv.notify_all();
+            eventfd_write(eventFd, 1);
+        }
+    }
+
+    void GroupCommit::Callback_Complete(void *, short)
+    {
+        eventfd_t value;
+        eventfd_read(eventFd, &value);
+
+        std::vector<URingRequest *> completed;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            completed.swap(served);
+        }
+
+        for (URingRequest *req : completed)
+        {
+            req->state.store(URING_STATE_DONE, std::memory_order_release);
+            if (req->ctx)
+                cp(req->ctx);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef HSLL_COMMIT
+#define HSLL_COMMIT
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "../Uring/Uring.h"
+
+namespace HSLL
+{
+    /// Durability mode of completed uploads
+    enum COMMIT_MODE
+    {
+        COMMIT_MODE_NONE,      //!< Report completion once the data is in the page cache
+        COMMIT_MODE_FDATASYNC, //!< fdatasync() every file of the batch, then fsync() each parent directory once
+        COMMIT_MODE_SYNCFS     //!< syncfs() once per file system of the batch, also covering directory entries
+    };
+
+    /**
+     * @brief Group commit of completed uploads
+     * @details Uploads that finish within the same window are flushed together by one background thread,
+     *          so many small files share the cost of a disk flush. In fdatasync mode writeback of the whole
+     *          batch is started before the first file is waited for, and each parent directory is flushed
+     *          once so new names survive a crash. A ticket for a directory flushes the directory itself.
+     *          A ticket uses the session's URingRequest
+     *          slot: Sync() queues it in flight and the flusher completes it through an eventfd on the event
+     *          loop thread, so a parked transfer waits for it like for any file operation
+     */
+    class GroupCommit
+    {
+    private:
+        static COMMIT_MODE mode;                     //!< Active mode
+        static unsigned int window;                  //!< Batching window in milliseconds
+        static int eventFd;                          //!< Completion notification descriptor
+        static CompleteProc cp;                      //!< Completion callback
+        static EVWatcher *watcher;                   //!< Watches the completion eventfd
+        static std::thread flusher;                  //!< Background flushing thread
+        static std::mutex mtx;                       //!< Protects the lists below and stopping
+        static std::condition_variable queueCv;      //!< Signals queued tickets
+        static std::condition_variable serveCv;      //!< Signals a finished batch
+        static std::vector<URingRequest *> queued;   //!< Tickets waiting for the next batch
+        static std::vector<URingRequest *> flushing; //!< Tickets of the batch being flushed
+        static std::vector<URingRequest *> served;   //!< Flushed tickets, not yet reaped
+        static bool stopping;                        //!< The flusher is asked to exit
+
+        /**
+         * @brief Flusher thread body
+         */
+        static void Flush();
+
+        /**
+         * @brief Event loop callback for the completion eventfd
+         * @param ctx Unused
+         * @param events Triggered event flags
+         */
+        static void Callback_Complete(void *ctx, short events);
+
+    public:
+        /**
+         * @brief Start the flusher
+         * @param mode Durability mode, COMMIT_MODE_NONE keeps group commit disabled
+         * @param window Batching window in milliseconds
+         * @param cp Callback invoked on the event loop thread when a ticket completes
+         * @return true on success (or when disabled), false if the flusher could not be started
+         * @note EVSocket must be constructed first
+         */
+        static bool Init(COMMIT_MODE mode, unsigned int window, CompleteProc cp);
+
+        /**
+         * @brief Stop the flusher
+         */
+        static void Release();
+
+        /**
+         * @brief Check whether uploads are committed before completion is reported
+         */
+        static bool Enabled();
+
+        /**
+         * @brief Queue a file for the next batch or consume the batch result
+         * @param req Request slot of the session, must be idle or hold this ticket
+         * @param fd File to flush, kept open until the ticket completes
+         * @return 0 once committed, -1 with errno EAGAIN while pending, -1 with errno set on failure
+         */
+        static int Sync(URingRequest &req, int fd);
+
+        /**
+         * @brief Withdraw a ticket, waiting for its batch if it is being flushed
+         * @param req Request slot, ignored unless it holds a ticket
+         * @note Must be called on the event loop thread
+         */
+        static void Cancel(URingRequest &req);
+    };
+}
+
+#endif
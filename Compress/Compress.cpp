@@ -0,0 +1,121 @@
+#include "Compress.h"
+
+namespace HSLL
+{
+    int ZStream::level = Z_DEFAULT_COMPRESSION;
+    std::mutex ZStream::mtx;
+    std::vector<ZStream *> ZStream::deflaters;
+    std::vector<ZStream *> ZStream::inflaters;
+
+    ZStream::ZStream(bool inflating) : zs{}, inflating(inflating), finished(false)
+    {
+    }
+
+    ZStream::~ZStream()
+    {
+        if (inflating)
+            inflateEnd(&zs);
+        else
+            deflateEnd(&zs);
+    }
+
+    void ZStream::Init(int level)
+    {
+        ZStream::level = level;
+    }
+
+    void ZStream::Release()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        for (ZStream *stream : deflaters)
+            delete stream;
+        for (ZStream *stream : inflaters)
+            delete stream;
+
+        deflaters.clear();
+        inflaters.clear();
+    }
+
+    ZStream *ZStream::Acquire(bool inflating)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::vector<ZStream *> &idle = inflating ? inflaters : deflaters;
+            if (!idle.empty())
+            {
+                ZStream *stream = idle.back();
+                idle.pop_back();
+                return stream;
+            }
+        }
+
+        ZStream *stream = new ZStream(inflating);
+        int ret = inflating ? inflateInit(&stream->zs) : deflateInit(&stream->zs, level);
+        if (ret != Z_OK)
+        {
+            delete stream;
+            return nullptr;
+        }
+        return stream;
+    }
+
+    void ZStream::Recycle(ZStream *stream)
+    {
+        if (stream->inflating)
+            inflateReset(&stream->zs);
+        else
+            deflateReset(&stream->zs);
+
+        stream->zs.next_in = nullptr;
+        stream->zs.avail_in = 0;
+        stream->finished = false;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<ZStream *> &idle = stream->inflating ? inflaters : deflaters;
+        if (idle.size() < HSLL_ZSTREAM_IDLE)
+            idle.push_back(stream);
+        else
+            delete stream;
+    }
+
+    void ZStream::Input(const void *data, size_t len)
+    {
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)len;
+    }
+
+    ssize_t ZStream::Process(bool finish)
+    {
+        zs.next_out = out;
+        zs.avail_out = sizeof(out);
+
+        if (finished)
+        {
+            // Anything after the end of the compressed stream is discarded
+            zs.avail_in = 0;
+            return 0;
+        }
+
+        int ret = inflating ? inflate(&zs, Z_NO_FLUSH) : deflate(&zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+            finished = true;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            return -1;
+
+        return (ssize_t)(sizeof(out) - zs.avail_out);
+    }
+
+    bool ZStream::Pending(bool finish) const
+    {
+        if (finished)
+            return false;
+
+        return zs.avail_in > 0 || zs.avail_out == 0 || (finish && !inflating);
+    }
+
+    bool ZStream::Finished() const
+    {
+        return finished;
+    }
+}
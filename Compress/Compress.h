@@ -0,0 +1,102 @@
+#ifndef HSLL_COMPRESS
+#define HSLL_COMPRESS
+
+#include <mutex>
+#include <vector>
+#include <zlib.h>
+#include <sys/types.h>
+
+/**
+ * @brief Size of the output buffer carried by each pooled stream
+ */
+#define HSLL_ZSTREAM_CHUNK (64 * 1024)
+
+/**
+ * @brief Maximum number of idle streams of each kind kept for reuse
+ */
+#define HSLL_ZSTREAM_IDLE 32
+
+namespace HSLL
+{
+    /**
+     * @brief Pooled zlib stream for MODE Z transfers
+     * @details Deflate and inflate states are large and costly to set up, so finished streams are reset and
+     *          kept on a free list together with their output buffer. A transfer feeds input with Input(),
+     *          then calls Process() and forwards the produced bytes until Pending() turns false
+     */
+    class ZStream
+    {
+    private:
+        z_stream zs;    //!< zlib state
+        bool inflating; //!< Decompresses (STOR) instead of compressing (RETR/LIST)
+        bool finished;  //!< End of the compressed stream reached
+
+        static int level;                        //!< Deflate compression level
+        static std::mutex mtx;                   //!< Protects the free lists
+        static std::vector<ZStream *> deflaters; //!< Idle compressing streams
+        static std::vector<ZStream *> inflaters; //!< Idle decompressing streams
+
+        /**
+         * @brief Constructor
+         * @param inflating Whether the stream decompresses
+         */
+        explicit ZStream(bool inflating);
+
+        ~ZStream();
+
+    public:
+        unsigned char out[HSLL_ZSTREAM_CHUNK]; //!< Output of the last Process() call
+
+        /**
+         * @brief Set the compression level of new deflate streams
+         * @param level zlib level, 0 (store) to 9 (best)
+         */
+        static void Init(int level);
+
+        /**
+         * @brief Free all idle streams
+         */
+        static void Release();
+
+        /**
+         * @brief Take a reset stream from the pool, creating one if none is idle
+         * @param inflating Whether the stream decompresses
+         * @return Stream, or nullptr if zlib could not allocate its state
+         */
+        static ZStream *Acquire(bool inflating);
+
+        /**
+         * @brief Reset a stream and return it to the pool
+         * @param stream Stream obtained from Acquire()
+         */
+        static void Recycle(ZStream *stream);
+
+        /**
+         * @brief Provide the next block of input
+         * @param data Input bytes, must stay valid until Pending() is false
+         * @param len Input length
+         */
+        void Input(const void *data, size_t len);
+
+        /**
+         * @brief Run zlib into out
+         * @param finish Compress: no more input follows and the stream should be terminated
+         * @return Number of bytes written to out, or -1 on corrupt compressed input
+         */
+        ssize_t Process(bool finish);
+
+        /**
+         * @brief Check whether another Process() call can produce output from the current input
+         * @return true until the input is consumed and all output produced
+         */
+        bool Pending(bool finish) const;
+
+        /**
+         * @brief Check whether the end of the compressed stream has been reached
+         * @return true after the final block was produced (deflate) or consumed (inflate)
+         */
+        bool Finished() const;
+    };
+}
+
+#endif
@@ -34,6 +34,20 @@ namespace HSLL
         return evbuffer_add(output, buf, size);
     }
 
+    int EVBuffer::Flush()
+    {
+        if (evbuffer_get_length(output) == 0)
+            return 0;
+
+        // The socket bufferevent freezes the start of its output buffer; lift it for this write only
+        bufferevent_lock(bev);
+        evbuffer_unfreeze(output, 1);
+        int ret = evbuffer_write(output, bufferevent_getfd(bev));
+        evbuffer_freeze(output, 1);
+        bufferevent_unlock(bev);
+        return ret;
+    }
+
     int EVBuffer::EnableWR()
     {
         return bufferevent_enable(bev, EV_READ | EV_WRITE);
@@ -50,6 +64,47 @@ namespace HSLL
         output = bufferevent_get_output(bev);
     }
 
+    EVWatcher::EVWatcher(WatchProc wp, void *ctx) : ev(nullptr), wp(wp), ctx(ctx)
+    {
+    }
+
+    EVWatcher::~EVWatcher()
+    {
+        if (ev)
+            event_free(ev);
+    }
+
+    void EVWatcher::Callback_Watch(evutil_socket_t, short events, void *ctx)
+    {
+        EVWatcher *watcher = (EVWatcher *)ctx;
+        watcher->wp(watcher->ctx, events);
+    }
+
+    int EVWatcher::Watch(int fd, short events, unsigned int seconds)
+    {
+        if (ev == nullptr)
+        {
+            ev = event_new(EVSocket::base, fd, events, Callback_Watch, this);
+            if (ev == nullptr)
+                return -1;
+        }
+        else
+        {
+            event_del(ev);
+            if (event_assign(ev, EVSocket::base, fd, events, Callback_Watch, this) != 0)
+                return -1;
+        }
+
+        timeval timeout = {(time_t)seconds, 0};
+        return event_add(ev, seconds ? &timeout : nullptr);
+    }
+
+    void EVWatcher::Cancel()
+    {
+        if (ev)
+            event_del(ev);
+    }
+
     void EVSocket::GetHostInfo(sockaddr *address, ConnectionInfo *info)
     {
         sockaddr_in *addr_in = (sockaddr_in *)(address);
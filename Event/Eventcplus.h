@@ -107,6 +107,13 @@ namespace HSLL
          */
         int Write(const void *buf, unsigned int size);
 
+        /**
+         * @brief Write pending output directly to the socket
+         * @details Used while events are disabled, when the event loop would not flush the buffer
+         * @return Number of bytes written, -1 on failure
+         */
+        int Flush();
+
         /**
          * @brief Enable read and write events
          * @return 0 on success, -1 on failure
@@ -132,6 +139,56 @@ namespace HSLL
     typedef void (*CloseProc)(void *ctx);                            //!< Connection close callback
     typedef bool (*ReadProc)(void *ctx);                             //!< Data readable callback
     typedef bool (*WriteProc)(void *ctx);                            //!< Data writable callback
+    typedef void (*WatchProc)(void *ctx, short events);              //!< Watched descriptor ready callback
+
+    /**
+     * @brief Watcher for an arbitrary descriptor on the server event loop
+     * @details Lets components outside the bufferevent model (data sockets, completion queues)
+     *          be dispatched by the same event_base. Callbacks run on the event loop thread
+     */
+    class EVWatcher
+    {
+        event *ev;    //!< libevent event object, created on first Watch()
+        WatchProc wp; //!< Ready callback
+        void *ctx;    //!< User context passed to the callback
+
+        /**
+         * @brief libevent callback forwarding to the user callback
+         * @param fd Watched descriptor
+         * @param events Triggered event flags (EV_READ, EV_WRITE, EV_TIMEOUT)
+         * @param ctx EVWatcher instance pointer
+         */
+        static void Callback_Watch(evutil_socket_t fd, short events, void *ctx);
+
+    public:
+        /**
+         * @brief Constructor
+         * @param wp Callback invoked when the watched condition triggers
+         * @param ctx User context passed to the callback
+         */
+        EVWatcher(WatchProc wp, void *ctx);
+
+        ~EVWatcher();
+
+        /**
+         * @brief Start watching a descriptor, replacing any previous watch
+         * @param fd Descriptor to watch
+         * @param events EV_READ and/or EV_WRITE, optionally EV_PERSIST
+         * @param seconds Timeout in seconds, 0 for none
+         * @return 0 on success, -1 on failure
+         * @note May be called from any thread once EVSocket has been constructed
+         */
+        int Watch(int fd, short events, unsigned int seconds);
+
+        /**
+         * @brief Stop watching, the callback will not be invoked afterwards
+         */
+        void Cancel();
+
+        // Disable copy constructor and assignment operator
+        EVWatcher(const EVWatcher &) = delete;
+        EVWatcher &operator=(const EVWatcher &) = delete;
+    };
 
     /**
      * @brief Event-driven Socket core class
@@ -142,6 +199,7 @@ namespace HSLL
     {
     private:
         friend class EVBuffer;
+        friend class EVWatcher;
 
         unsigned short port;   //!< Listening port number
         unsigned short status; //!< Status flag (0:uninitialized 1:configured 2:running)
@@ -4,7 +4,10 @@
 #include <fstream>
 #include <unistd.h>
 #include <dirent.h>
+#include <fnmatch.h>
+#include <algorithm>
 #include <langinfo.h>
+#include <sys/sendfile.h>
 
 #include "FtpServer.h"
 
@@ -15,9 +18,27 @@ namespace HSLL
     char ServerInfo::ip[INET_ADDRSTRLEN];
     bool ServerInfo::utf8 = false;
     bool ServerInfo::anonymous = false;
+    bool ServerInfo::uring = false;
     unsigned int ServerInfo::rwtimeout = 5;
     unsigned short ServerInfo::port = 4567;
+    unsigned short ServerInfo::pasvLow = 0;
+    unsigned short ServerInfo::pasvHigh = 0;
+    int ServerInfo::deflateLevel = 6;
+    bool ServerInfo::hugepages = false;
+    off_t ServerInfo::cacheDropSize = 512LL * 1024 * 1024;
+    off_t ServerInfo::directSize = 0;
+    unsigned int ServerInfo::uploadTTL = 60;
+    COMMIT_MODE ServerInfo::durability = COMMIT_MODE_NONE;
+    unsigned int ServerInfo::commitWindow = 10;
+    size_t ServerInfo::listCacheSize = 16 * 1024 * 1024;
+    size_t ServerInfo::prefetchSize = 4 * 1024 * 1024;
+    off_t ServerInfo::sizeReadahead = 0;
+    int ServerInfo::treeDepth = 16;
+    size_t ServerInfo::treeEntries = 200000;
     std::set<std::pair<std::string, std::string>> ServerInfo::users;
+    std::mutex UploadTable::mtx;
+    std::map<std::string, UploadTable::Entry> UploadTable::entries;
+    unsigned long long UploadTable::ids = 0;
 
     void trim(std::string &s)
     {
@@ -147,6 +168,38 @@ namespace HSLL
                 }
                 ++i;
             }
+            else if (param == "hugepages")
+            {
+                if (value == "true")
+                {
+                    ServerInfo::hugepages = true;
+                }
+                else if (value == "false")
+                {
+                    ServerInfo::hugepages = false;
+                }
+                else
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "io_uring")
+            {
+                if (value == "true")
+                {
+                    ServerInfo::uring = true;
+                }
+                else if (value == "false")
+                {
+                    ServerInfo::uring = false;
+                }
+                else
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
             else if (param == "port")
             {
                 try
@@ -164,6 +217,218 @@ namespace HSLL
                 }
                 ++i;
             }
+            else if (param == "deflate_level")
+            {
+                if (value.size() != 1 || !isdigit((unsigned char)value[0]))
+                    goto exitFalse;
+
+                ServerInfo::deflateLevel = value[0] - '0';
+                ++i;
+            }
+            else if (param == "cache_drop_size")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num > (1ULL << 40))
+                        goto exitFalse;
+
+                    ServerInfo::cacheDropSize = (off_t)(num * 1024 * 1024);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "upload_ttl")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long num = std::stoul(value, &pos);
+                    if (pos != value.size() || num == 0 || num > UINT_MAX)
+                        goto exitFalse;
+
+                    ServerInfo::uploadTTL = (unsigned int)num;
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "direct_io_size")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num > (1ULL << 40))
+                        goto exitFalse;
+
+                    ServerInfo::directSize = (off_t)(num * 1024 * 1024);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "durability")
+            {
+                if (value == "none")
+                {
+                    ServerInfo::durability = COMMIT_MODE_NONE;
+                }
+                else if (value == "fdatasync")
+                {
+                    ServerInfo::durability = COMMIT_MODE_FDATASYNC;
+                }
+                else if (value == "syncfs")
+                {
+                    ServerInfo::durability = COMMIT_MODE_SYNCFS;
+                }
+                else
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "commit_window")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long num = std::stoul(value, &pos);
+                    if (pos != value.size() || num > 1000)
+                        goto exitFalse;
+
+                    ServerInfo::commitWindow = (unsigned int)num;
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "list_cache_size")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num > (1ULL << 20))
+                        goto exitFalse;
+
+                    ServerInfo::listCacheSize = (size_t)(num * 1024 * 1024);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "prefetch_size")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num > (1ULL << 20))
+                        goto exitFalse;
+
+                    ServerInfo::prefetchSize = (size_t)(num * 1024 * 1024);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "size_readahead")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num > (1ULL << 20))
+                        goto exitFalse;
+
+                    ServerInfo::sizeReadahead = (off_t)(num * 1024 * 1024);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "tree_max_depth")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long num = std::stoul(value, &pos);
+                    if (pos != value.size() || num > 1024)
+                        goto exitFalse;
+
+                    ServerInfo::treeDepth = (int)num;
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "tree_max_entries")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long long num = std::stoull(value, &pos);
+                    if (pos != value.size() || num == 0 || num > (1ULL << 32))
+                        goto exitFalse;
+
+                    ServerInfo::treeEntries = (size_t)num;
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
+            else if (param == "pasv_ports")
+            {
+                try
+                {
+                    size_t pos;
+                    unsigned long low = std::stoul(value, &pos);
+                    unsigned long high = low;
+
+                    if (pos != value.size())
+                    {
+                        if (value[pos] != '-')
+                            goto exitFalse;
+
+                        std::string rest = value.substr(pos + 1);
+                        high = std::stoul(rest, &pos);
+                        if (pos != rest.size())
+                            goto exitFalse;
+                    }
+
+                    if (high > USHRT_MAX || high < low || (low == 0 && high != 0))
+                        goto exitFalse;
+
+                    ServerInfo::pasvLow = static_cast<unsigned short>(low);
+                    ServerInfo::pasvHigh = static_cast<unsigned short>(high);
+                }
+                catch (...)
+                {
+                    goto exitFalse;
+                }
+                ++i;
+            }
             else if (param == "users")
             {
                 while (i < lines.size())
@@ -203,6 +468,135 @@ namespace HSLL
         return false;
     }
 
+    void UploadTable::Erase(std::map<std::string, Entry>::iterator it)
+    {
+        unlink(it->second.tempPath.c_str());
+        entries.erase(it);
+    }
+
+    int UploadTable::Open(const std::string &path, off_t size, unsigned long long &id)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second.writers == 0 && !it->second.committing &&
+                now - it->second.touched > std::chrono::seconds(ServerInfo::uploadTTL))
+            {
+                HSLL_LOGINFO(LOG_LEVEL_INFO, "Ranged upload abandoned: ", it->first)
+                Erase(it++);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        auto it = entries.find(path);
+        if (it != entries.end())
+        {
+            if (it->second.size != size || it->second.committing)
+            {
+                errno = it->second.committing ? EBUSY : EINVAL;
+                return -1;
+            }
+
+            int fd = open(it->second.tempPath.c_str(), O_WRONLY);
+            if (fd >= 0)
+            {
+                ++it->second.writers;
+                it->second.touched = now;
+                id = it->second.id;
+            }
+            return fd;
+        }
+
+        size_t index = path.find_last_of('/');
+        std::string tempPath = path.substr(0, index + 1) + "." + path.substr(index + 1) + ".part";
+
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return -1;
+
+        // Reserve the whole extent up front so parallel ranges neither fragment the file nor run out of space midway
+        if (fallocate(fd, 0, 0, size) != 0 && (errno == ENOSPC || ftruncate(fd, size) != 0))
+        {
+            int err = errno;
+            close(fd);
+            unlink(tempPath.c_str());
+            errno = err;
+            return -1;
+        }
+
+        id = ++ids;
+        entries[path] = Entry{tempPath, size, 0, {}, id, 1, false, now};
+        return fd;
+    }
+
+    int UploadTable::Store(const std::string &path, unsigned long long id, off_t first, off_t end, bool success)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.id != id)
+            return -1;
+
+        Entry &entry = it->second;
+        --entry.writers;
+        entry.touched = std::chrono::steady_clock::now();
+        if (first < end)
+        {
+            auto range = entry.ranges.upper_bound(first);
+            if (range != entry.ranges.begin() && std::prev(range)->second >= first)
+                --range;
+
+            while (range != entry.ranges.end() && range->first <= end)
+            {
+                first = std::min(first, range->first);
+                end = std::max(end, range->second);
+                entry.stored -= range->second - range->first;
+                range = entry.ranges.erase(range);
+            }
+
+            entry.ranges[first] = end;
+            entry.stored += end - first;
+        }
+
+        // Another writer may still be rewriting a range of the file, and a failed one was never flushed
+        if (!success || entry.writers > 0 || entry.stored < entry.size)
+            return 0;
+
+        entry.committing = true;
+        return 1;
+    }
+
+    bool UploadTable::Finish(const std::string &path, unsigned long long id, bool commit)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.id != id)
+            return false;
+
+        if (!commit)
+        {
+            it->second.committing = false;
+            it->second.touched = std::chrono::steady_clock::now();
+            return false;
+        }
+
+        bool ret = (rename(it->second.tempPath.c_str(), path.c_str()) == 0);
+        entries.erase(it);
+        return ret;
+    }
+
+    void UploadTable::Drop(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(path);
+        if (it != entries.end())
+            Erase(it);
+    }
+
     std::string ToUpperCase(const std::string &str)
     {
         std::string result = str;
@@ -216,21 +610,20 @@ namespace HSLL
         return result;
     }
 
-    void FTPServer::SetSocketTimeout(int socket, int seconds)
+    void FTPServer::SetSocketNonBlocking(int socket)
     {
-        struct timeval timeout;
-        timeout.tv_sec = seconds;
-        timeout.tv_usec = 0;
-
-        if (setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout)) < 0)
+        int flags = fcntl(socket, F_GETFL, 0);
+        if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0)
         {
-            HSLL_LOGINFO(LOG_LEVEL_WARNING, "Failed to set socket receive timeout");
+            HSLL_LOGINFO(LOG_LEVEL_WARNING, "Failed to set socket non-blocking");
         }
+    }
 
-        if (setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout)) < 0)
-        {
-            HSLL_LOGINFO(LOG_LEVEL_WARNING, "Failed to set socket send timeout");
-        }
+    std::suspend_always FTPServer::WaitFor(int fd, short events)
+    {
+        waitFd = fd;
+        waitEvents = events;
+        return {};
     }
 
     std::string convertEncoding(const std::string &input, const std::string &fromEncoding, const std::string &toEncoding)
@@ -262,83 +655,191 @@ namespace HSLL
         return output;
     }
 
-    bool FTPServer::EstablishDataConnection()
+    /**
+     * @brief Split ls-style options off a LIST/STAT argument
+     * @param param Command argument, such as "-lR dir"
+     * @param path Receives the path following the options, empty for the current directory
+     * @return true if the options ask for a recursive listing (-R); other options are ignored
+     */
+    static bool ParseListOptions(const std::string &param, std::string &path)
     {
-        if (dataMode == DATA_MODE_PASSIVE)
+        if (param.empty() || param[0] != '-')
         {
-            if (pasvSocket == -1)
-                return false;
-
-            struct timeval timeout = {ServerInfo::rwtimeout, 0};
-            setsockopt(pasvSocket, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
+            path = param;
+            return false;
+        }
 
-            struct sockaddr_in clientAddr;
-            socklen_t clientAddrLen = sizeof(clientAddr);
-            dataSocket = accept(pasvSocket, (struct sockaddr *)&clientAddr, &clientAddrLen);
+        size_t space = param.find(' ');
+        size_t start = (space == std::string::npos) ? std::string::npos : param.find_first_not_of(' ', space);
+        path = (start == std::string::npos) ? std::string() : param.substr(start);
+        return param.find('R') < space;
+    }
 
-            close(pasvSocket);
-            pasvSocket = -1;
+    /**
+     * @brief Per-worker pipe used to splice uploads from the data socket into the file
+     */
+    struct SplicePipe
+    {
+        int fds[2]; //!< Read and write ends, -1 when the pipe could not be created
 
-            if (dataSocket == -1)
+        SplicePipe()
+        {
+            if (pipe2(fds, O_CLOEXEC) != 0)
             {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
-                    return false;
+                fds[0] = fds[1] = -1;
+                return;
             }
-            SetSocketTimeout(dataSocket, ServerInfo::rwtimeout);
+            fcntl(fds[1], F_SETPIPE_SZ, HSLL_FTP_SPLICE_CHUNK);
         }
-        else if (dataMode == DATA_MODE_ACTIVE)
-        {
-            if (dataSocket == -1)
-                return false;
-
-            int flags = fcntl(dataSocket, F_GETFL, 0);
-            fcntl(dataSocket, F_SETFL, flags | O_NONBLOCK);
 
-            sockaddr_in clientAddr = {0};
-            clientAddr.sin_family = AF_INET;
-            clientAddr.sin_port = htons((short)clientPort);
-            inet_pton(AF_INET, clientIP.c_str(), &clientAddr.sin_addr);
+        ~SplicePipe()
+        {
+            if (fds[0] != -1)
+            {
+                close(fds[0]);
+                close(fds[1]);
+            }
+        }
+    };
+
+    thread_local SplicePipe splicePipe;
+
+    /**
+     * @brief Move up to one chunk from a socket into a file through the calling worker's pipe
+     * @details The pipe is always left empty on return, so the coroutine may resume on another worker.
+     *          Kept out of line so the thread-local pipe is looked up again after every suspension
+     * @return Bytes stored, 0 on end of stream, -1 on socket error (errno set), -2 on storage error
+     */
+    __attribute__((noinline)) ssize_t SpliceToFile(int socket, int fileHandle, size_t chunk)
+    {
+        SplicePipe &pipe = splicePipe;
+        if (pipe.fds[0] == -1)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+
+        ssize_t received = splice(socket, nullptr, pipe.fds[1], nullptr, chunk, SPLICE_F_MOVE);
+        if (received <= 0)
+            return received;
 
-            int connectResult = connect(dataSocket, (struct sockaddr *)&clientAddr, sizeof(clientAddr));
-            if (connectResult < 0 && errno != EINPROGRESS)
+        ssize_t left = received;
+        while (left > 0)
+        {
+            ssize_t result = splice(pipe.fds[0], nullptr, fileHandle, nullptr, (size_t)left, SPLICE_F_MOVE);
+            if (result <= 0)
             {
+                char discard[8192];
+                while (left > 0 && (result = read(pipe.fds[0], discard, std::min((size_t)left, sizeof(discard)))) > 0)
+                    left -= result;
+                return -2;
+            }
+            left -= result;
+        }
+        return received;
+    }
+
+    int FTPServer::EstablishDataConnection()
+    {
+        connecting = false;
+
+        if (waitExpired)
+        {
+            waitExpired = false;
+            CloseDataConnection();
+            return -1;
+        }
+
+        if (dataMode == DATA_MODE_PASSIVE)
+        {
+            if (pasvSocket == -1)
+                return -1;
+
+            if (URing::Enabled())
+            {
+                dataSocket = URing::Accept(ioRequest, pasvSocket);
+                if (dataSocket == -1 && URing::Pending(ioRequest))
+                    return 0;
+            }
+            else
+            {
+                dataSocket = accept4(pasvSocket, nullptr, nullptr, SOCK_NONBLOCK);
+                if (dataSocket == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED))
+                {
+                    connecting = true;
+                    WaitFor(pasvSocket, EV_READ);
+                    return 0;
+                }
+            }
+
+            PortPool::Release(pasvSocket, pasvPort);
+            pasvSocket = -1;
+
+            if (dataSocket == -1)
+                return -1;
+
+            // Passive ports can be guessed, so only the client of this session may use its data connection
+            sockaddr_in peerAddr{};
+            socklen_t peerLength = sizeof(peerAddr);
+            char peerIP[INET_ADDRSTRLEN];
+            if (getpeername(dataSocket, (struct sockaddr *)&peerAddr, &peerLength) != 0 ||
+                inet_ntop(AF_INET, &peerAddr.sin_addr, peerIP, sizeof(peerIP)) == nullptr || strcmp(peerIP, info.ip) != 0)
+            {
+                HSLL_LOGINFO(LOG_LEVEL_WARNING, info.ip, ":", info.port, " Rejected a data connection from another host")
                 close(dataSocket);
                 dataSocket = -1;
-                return false;
+                return -1;
             }
+        }
+        else if (dataMode == DATA_MODE_ACTIVE)
+        {
+            if (dataSocket == -1)
+                return -1;
 
-            if (connectResult < 0)
-            {
-                fd_set write_fds;
-                FD_ZERO(&write_fds);
-                FD_SET(dataSocket, &write_fds);
+            sockaddr_in clientAddr = {0};
+            clientAddr.sin_family = AF_INET;
+            clientAddr.sin_port = htons((short)clientPort);
+            inet_pton(AF_INET, clientIP.c_str(), &clientAddr.sin_addr);
 
-                struct timeval timeout = {ServerInfo::rwtimeout, 0};
-                if (select(dataSocket + 1, NULL, &write_fds, NULL, &timeout) <= 0)
+            if (URing::Enabled())
+            {
+                if (URing::Connect(ioRequest, dataSocket, &clientAddr) < 0)
                 {
+                    if (URing::Pending(ioRequest))
+                        return 0;
+
                     close(dataSocket);
                     dataSocket = -1;
-                    return false;
+                    return -1;
+                }
+                return 1;
+            }
+
+            SetSocketNonBlocking(dataSocket);
+
+            // Repeated calls report progress: EALREADY while pending, EISCONN once established
+            if (connect(dataSocket, (struct sockaddr *)&clientAddr, sizeof(clientAddr)) < 0)
+            {
+                if (errno == EINPROGRESS || errno == EALREADY)
+                {
+                    connecting = true;
+                    WaitFor(dataSocket, EV_WRITE);
+                    return 0;
                 }
 
-                int error = 0;
-                socklen_t len = sizeof(error);
-                if (getsockopt(dataSocket, SOL_SOCKET, SO_ERROR, &error, &len) || error)
+                if (errno != EISCONN)
                 {
                     close(dataSocket);
                     dataSocket = -1;
-                    return false;
+                    return -1;
                 }
             }
-
-            fcntl(dataSocket, F_SETFL, flags);
-            SetSocketTimeout(dataSocket, ServerInfo::rwtimeout);
         }
         else
         {
-            return false;
+            return -1;
         }
-        return true;
+        return 1;
     }
 
     void FTPServer::CloseDataConnection()
@@ -351,9 +852,139 @@ namespace HSLL
 
         if (pasvSocket != -1)
         {
-            close(pasvSocket);
+            PortPool::Release(pasvSocket, pasvPort);
             pasvSocket = -1;
         }
+
+        if (zstream != nullptr)
+        {
+            ZStream::Recycle(zstream);
+            zstream = nullptr;
+        }
+
+        ReturnBuffers();
+    }
+
+    bool FTPServer::BorrowBuffers(off_t position, bool stage)
+    {
+        size_t size = bufferHint;
+
+        ReturnBuffers();
+
+        // TYPE A output can be twice the input, so its blocks are capped and the conversion buffer has a fixed size
+        if (transferType == TRANSFER_TYPE_ASCII)
+        {
+            size = std::min(size, (size_t)HSLL_FTP_TEXT_BLOCK);
+            textBufferSize = 2 * std::max((size_t)HSLL_FTP_TEXT_BLOCK, (size_t)HSLL_ZSTREAM_CHUNK);
+            if ((textBuffer = BufferPool::Acquire(textBufferSize)) == nullptr)
+                return false;
+        }
+
+        if (stage)
+        {
+            size_t stageSize = HSLL_FTP_STAGE_SIZE;
+            if ((stageBuffer = BufferPool::Acquire(stageSize)) == nullptr)
+                return false;
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            ioSizes[i] = size;
+            if ((ioBuffers[i] = BufferPool::Acquire(ioSizes[i])) == nullptr)
+                return false;
+        }
+
+        rateTime = std::chrono::steady_clock::now();
+        ratePosition = position;
+        return true;
+    }
+
+    void FTPServer::TuneBuffer(int index, off_t position)
+    {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - rateTime).count();
+        if (elapsed >= 0.2)
+        {
+            bufferHint = BufferPool::SizeFor((double)(position - ratePosition) / elapsed);
+            rateTime = now;
+            ratePosition = position;
+        }
+
+        size_t size = bufferHint;
+        if (transferType == TRANSFER_TYPE_ASCII)
+            size = std::min(size, (size_t)HSLL_FTP_TEXT_BLOCK);
+
+        // Each buffer switches on its own, once the block it carried has been consumed
+        if (size == ioSizes[index])
+            return;
+
+        char *buffer = BufferPool::Acquire(size);
+        if (buffer == nullptr)
+            return;
+
+        BufferPool::Recycle(ioBuffers[index], ioSizes[index]);
+        ioBuffers[index] = buffer;
+        ioSizes[index] = size;
+    }
+
+    void FTPServer::ReturnBuffers()
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            if (ioBuffers[i] != nullptr)
+            {
+                BufferPool::Recycle(ioBuffers[i], ioSizes[i]);
+                ioBuffers[i] = nullptr;
+            }
+        }
+
+        if (textBuffer != nullptr)
+        {
+            BufferPool::Recycle(textBuffer, textBufferSize);
+            textBuffer = nullptr;
+        }
+
+        if (stageBuffer != nullptr)
+        {
+            BufferPool::Recycle(stageBuffer, HSLL_FTP_STAGE_SIZE);
+            stageBuffer = nullptr;
+        }
+    }
+
+    bool FTPServer::FindSized(const std::string &path, struct stat &st)
+    {
+        if (sizedFd < 0 || sizedPath != path)
+            return false;
+
+        if (std::chrono::steady_clock::now() - sizedTime > std::chrono::seconds(HSLL_FTP_SIZED_TTL))
+        {
+            DropSized();
+            return false;
+        }
+
+        st = sizedStat;
+        return true;
+    }
+
+    int FTPServer::TakeSized(const std::string &path)
+    {
+        if (sizedFd < 0 || sizedPath != path)
+            return -1;
+
+        int fd = sizedFd;
+        sizedFd = -1;
+        sizedPath.clear();
+        return fd;
+    }
+
+    void FTPServer::DropSized()
+    {
+        if (sizedFd >= 0)
+        {
+            close(sizedFd);
+            sizedFd = -1;
+        }
+        sizedPath.clear();
     }
 
     void FTPServer::HandlePORT(const std::string &param)
@@ -398,46 +1029,57 @@ namespace HSLL
 
     void FTPServer::HandlePASV()
     {
-        if (dataSocket != -1)
-        {
-            close(dataSocket);
-            dataSocket = -1;
-        }
+        CloseDataConnection();
 
-        pasvSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (pasvSocket < 0)
+        if (PortPool::Enabled())
         {
-            sWaitSend.append("425 Can't open passive socket.\r\n");
-            return;
+            pasvSocket = PortPool::Acquire(pasvPort);
+            if (pasvSocket == -1)
+            {
+                sWaitSend.append("425 No passive port available.\r\n");
+                return;
+            }
         }
+        else
+        {
+            pasvSocket = socket(AF_INET, SOCK_STREAM, 0);
+            if (pasvSocket < 0)
+            {
+                sWaitSend.append("425 Can't open passive socket.\r\n");
+                return;
+            }
 
-        int opt = 1;
-        setsockopt(pasvSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+            int opt = 1;
+            setsockopt(pasvSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-        sockaddr_in addr = {0};
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        addr.sin_port = 0;
+            if (!URing::Enabled())
+                SetSocketNonBlocking(pasvSocket);
 
-        if (bind(pasvSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-        {
-            close(pasvSocket);
-            pasvSocket = -1;
-            sWaitSend.append("425 Can't bind passive socket.\r\n");
-            return;
-        }
+            sockaddr_in addr = {0};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = 0;
 
-        if (listen(pasvSocket, 1) < 0)
-        {
-            close(pasvSocket);
-            pasvSocket = -1;
-            sWaitSend.append("425 Can't listen on passive socket.\r\n");
-            return;
-        }
+            if (bind(pasvSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            {
+                close(pasvSocket);
+                pasvSocket = -1;
+                sWaitSend.append("425 Can't bind passive socket.\r\n");
+                return;
+            }
 
-        socklen_t len = sizeof(addr);
-        getsockname(pasvSocket, (struct sockaddr *)&addr, &len);
-        int pasvPort = ntohs(addr.sin_port);
+            if (listen(pasvSocket, 1) < 0)
+            {
+                close(pasvSocket);
+                pasvSocket = -1;
+                sWaitSend.append("425 Can't listen on passive socket.\r\n");
+                return;
+            }
+
+            socklen_t len = sizeof(addr);
+            getsockname(pasvSocket, (struct sockaddr *)&addr, &len);
+            pasvPort = ntohs(addr.sin_port);
+        }
 
         std::vector<std::string> ipParts;
         std::stringstream ss(ServerInfo::ip);
@@ -455,8 +1097,94 @@ namespace HSLL
         sWaitSend.append("227 Entering Passive Mode (").append(pasvResponse).append(")\r\n");
     }
 
-    Generator<START_FLAG::START_FLAG_NOSUSPEND> FTPServer::HandleList()
+    void FTPServer::HandleMLST(const std::string &param)
+    {
+        std::string filePath = param.empty() ? currentDir : (param[0] == '/') ? param : currentDir + "/" + param;
+        struct stat statbuf;
+        if (stat(filePath.c_str(), &statbuf) != 0)
+        {
+            sWaitSend.append("550 File not found.\r\n");
+            return;
+        }
+
+        std::string facts(" ");
+        ListFormat::AppendFacts(facts, filePath.c_str(), statbuf);
+        if (utf8)
+            facts = convertEncoding(facts, ServerInfo::encoding, "UTF-8");
+        sWaitSend.append("250-Listing ").append(param.empty() ? "." : param).append("\r\n").append(facts).append("250 End.\r\n");
+    }
+
+    void FTPServer::HandleSTAT(const std::string &param)
     {
+        std::string target;
+        bool recursive = ParseListOptions(param, target);
+        std::string dirPath = target.empty() ? currentDir : (target[0] == '/') ? target : currentDir + "/" + target;
+        TreeWalker walker;
+        size_t limit = std::min(ServerInfo::treeEntries, (size_t)HSLL_FTP_STAT_ENTRIES);
+        if (!walker.Start(dirPath, target.empty() ? "." : target, recursive ? ServerInfo::treeDepth : 0, limit))
+        {
+            sWaitSend.append("550 Failed to open directory.\r\n");
+            return;
+        }
+
+        // The listing travels on the control connection, so every line is indented to keep it out of the reply codes
+        std::string text;
+        std::string listing;
+        while (true)
+        {
+            bool more = walker.Next(text, HSLL_FTP_LIST_CHUNK);
+            for (size_t begin = 0, end; begin < text.size(); begin = end + 1)
+            {
+                end = text.find('\n', begin);
+                listing.append(" ").append(text, begin, end - begin + 1);
+            }
+            text.clear();
+            if (!more)
+                break;
+        }
+
+        if (utf8)
+            listing = convertEncoding(listing, ServerInfo::encoding, "UTF-8");
+        sWaitSend.append("213-Status of ").append(target.empty() ? "." : target).append(":\r\n").append(listing);
+        if (walker.Truncated())
+            sWaitSend.append(" Listing truncated after ").append(std::to_string(walker.Entries())).append(" entries, use LIST -R for the full listing.\r\n");
+        sWaitSend.append("213 End of status.\r\n");
+    }
+
+    Generator<START_FLAG::START_FLAG_NOSUSPEND> FTPServer::HandleList(ListStyle style, const std::string &path)
+    {
+        std::string dirPath = path.empty() ? currentDir : (path[0] == '/') ? path : currentDir + "/" + path;
+        std::string shown = path.empty() ? "." : path;
+        std::string prefix;
+        std::string pattern;
+        bool literal = false;
+        bool dirsOnly = false;
+        int connected;
+
+        // An NLST argument with wildcards, or naming a file, is matched against the names of its directory;
+        // matches are reported with the directory part of the argument. A trailing slash keeps directories only
+        if (style == LIST_STYLE_NAMES && !path.empty())
+        {
+            struct stat argStat;
+            bool glob = (path.find_first_of("*?[") != std::string::npos);
+            literal = !glob && stat(dirPath.c_str(), &argStat) == 0 && !S_ISDIR(argStat.st_mode);
+
+            if (glob || literal)
+            {
+                std::string arg = path;
+                while (glob && arg.size() > 1 && arg.back() == '/')
+                {
+                    arg.pop_back();
+                    dirsOnly = true;
+                }
+
+                size_t slash = arg.find_last_of('/');
+                prefix = (slash == std::string::npos) ? std::string() : arg.substr(0, slash + 1);
+                pattern = arg.substr(slash + 1);
+                dirPath = prefix.empty() ? currentDir : (prefix[0] == '/') ? prefix : currentDir + "/" + prefix;
+            }
+        }
+
         sWaitSend.append("150 Opening data connection.\r\n");
 
         while (!Send())
@@ -466,84 +1194,208 @@ namespace HSLL
                 co_return;
         }
 
-        if (!EstablishDataConnection())
+        while ((connected = EstablishDataConnection()) == 0)
+        {
+            co_await std::suspend_always{};
+            if (error)
+                co_return;
+        }
+
+        if (connected < 0)
         {
             sWaitSend.append("425 Can't open data connection.\r\n");
             co_return;
         }
 
-        DIR *dir = opendir(currentDir.c_str());
-        if (!dir)
+        DirReader reader;
+        TreeWalker walker;
+        ListFormat format;
+        std::string text;
+        std::string block;
+        std::string copy;
+        std::shared_ptr<const std::string> cached;
+        unsigned long long token = 0;
+        unsigned long long total = 0;
+        size_t entries = 0;
+        size_t position = 0;
+        size_t cachedOffset = 0;
+        bool done = false;
+        bool last = false;
+        bool readError = false;
+        bool sendError = false;
+        const char *name;
+        unsigned char type;
+        struct stat statBuf;
+        auto started = std::chrono::steady_clock::now();
+
+        // The session lists the directory itself rather than wait on the background lane; a prefetch
+        // that already finished is found in the cache
+        if (style == LIST_STYLE_LONG && path.empty())
+            ListCache::Cancel(prefetch);
+
+        // Only the long format is cached; NLST needs no metadata and MLSD output is per request
+        if (style == LIST_STYLE_LONG && ListCache::Lookup(dirPath, utf8, cached, token))
+        {
+            entries = (size_t)std::count(cached->begin(), cached->end(), '\n');
+        }
+        else if (style == LIST_STYLE_TREE ? !walker.Start(dirPath, shown, ServerInfo::treeDepth, ServerInfo::treeEntries)
+                                          : !reader.Open(dirPath))
         {
             sWaitSend.append("550 Failed to open directory.\r\n");
             CloseDataConnection();
             co_return;
         }
 
-        std::string listing;
-        struct dirent *entry;
-        struct stat statBuf;
-        char timeBuf[80];
+        if (transferMode == TRANSFER_MODE_DEFLATE && (zstream = ZStream::Acquire(false)) == nullptr)
+        {
+            ListCache::Abandon(dirPath, token);
+            sWaitSend.append("451 Local error in processing.\r\n");
+            CloseDataConnection();
+            co_return;
+        }
 
-        while ((entry = readdir(dir)))
+        // The listing is produced and sent one bounded chunk at a time, so a huge directory neither
+        // holds its whole listing in memory nor delays the first byte until it has been read
+        while (true)
         {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            if (position < block.size())
+            {
+                ssize_t sent = URing::Send(ioRequest, dataSocket, block.data() + position, block.size() - position);
+                if (sent < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        co_await WaitFor(dataSocket, EV_WRITE);
+                        if (error)
+                        {
+                            ListCache::Abandon(dirPath, token);
+                            co_return;
+                        }
+                        continue;
+                    }
+                    sendError = true;
+                    break;
+                }
+                position += (size_t)sent;
+                total += (unsigned long long)sent;
                 continue;
+            }
 
-            std::string fullPath = currentDir + "/" + entry->d_name;
-            if (stat(fullPath.c_str(), &statBuf) != 0)
-                continue;
+            if (last)
+                break;
 
-            char perm[] = "----------";
-            perm[0] = S_ISDIR(statBuf.st_mode) ? 'd' : '-';
-            perm[1] = (statBuf.st_mode & S_IRUSR) ? 'r' : '-';
-            perm[2] = (statBuf.st_mode & S_IWUSR) ? 'w' : '-';
-            perm[3] = (statBuf.st_mode & S_IXUSR) ? 'x' : '-';
-            perm[4] = (statBuf.st_mode & S_IRGRP) ? 'r' : '-';
-            perm[5] = (statBuf.st_mode & S_IWGRP) ? 'w' : '-';
-            perm[6] = (statBuf.st_mode & S_IXGRP) ? 'x' : '-';
-            perm[7] = (statBuf.st_mode & S_IROTH) ? 'r' : '-';
-            perm[8] = (statBuf.st_mode & S_IWOTH) ? 'w' : '-';
-            perm[9] = (statBuf.st_mode & S_IXOTH) ? 'x' : '-';
+            block.clear();
+            position = 0;
 
-            strftime(timeBuf, sizeof(timeBuf), "%b %d %H:%M", localtime(&statBuf.st_mtime));
+            // A cached listing is shared with the cache, so it is sent in slices of the same bounded size
+            if (cached && !done)
+            {
+                size_t length = std::min((size_t)HSLL_FTP_LIST_CHUNK, cached->size() - cachedOffset);
+                text.assign(*cached, cachedOffset, length);
+                cachedOffset += length;
+                done = (cachedOffset == cached->size());
+            }
+            else if (!done)
+            {
+                text.clear();
+                if (style == LIST_STYLE_TREE)
+                {
+                    done = !walker.Next(text, HSLL_FTP_LIST_CHUNK);
+                    entries = walker.Entries();
+                }
 
-            char line[512];
-            snprintf(line, sizeof(line), "%s 1 owner group %8lld %s %s\r\n",
-                     perm, (long long)statBuf.st_size, timeBuf, entry->d_name);
-            listing += line;
-        }
+                while (style != LIST_STYLE_TREE && text.size() < HSLL_FTP_LIST_CHUNK)
+                {
+                    if (!reader.Next(name, type))
+                    {
+                        done = true;
+                        readError = (errno != 0);
+                        break;
+                    }
 
-        closedir(dir);
+                    if (style == LIST_STYLE_NAMES)
+                    {
+                        if (!pattern.empty() && (literal ? strcmp(pattern.c_str(), name) : fnmatch(pattern.c_str(), name, FNM_PERIOD)) != 0)
+                            continue;
 
-        if (utf8)
-            listing = convertEncoding(listing, ServerInfo::encoding, "UTF-8");
+                        // d_type answers the directory test; only file systems that do not report it cost a stat
+                        if (dirsOnly && type != DT_DIR &&
+                            ((type != DT_UNKNOWN && type != DT_LNK) || !reader.Stat(name, statBuf) || !S_ISDIR(statBuf.st_mode)))
+                            continue;
 
-        size_t totalSent = 0;
-        bool sendError = false;
-        while (totalSent < listing.length())
-        {
-            ssize_t sent = send(dataSocket, listing.c_str() + totalSent, listing.length() - totalSent, 0);
+                        text.append(prefix);
+                        ListFormat::AppendName(text, name);
+                    }
+                    else if (!reader.Stat(name, statBuf))
+                        continue;
+                    else if (style == LIST_STYLE_FACTS)
+                        ListFormat::AppendFacts(text, name, statBuf);
+                    else
+                        format.AppendLong(text, name, statBuf);
+                    ++entries;
+                }
 
-            if (sent < 0)
-            {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                if (readError)
+                    break;
+
+                // Chunks end on line boundaries, so they convert independently
+                if (utf8)
+                    text = convertEncoding(text, ServerInfo::encoding, "UTF-8");
+
+                // A copy is kept for the cache only while the listing can still be cached, and freed once it cannot
+                if (token && ListCache::Fits(copy.size() + text.size()))
                 {
-                    co_await std::suspend_always{};
-                    if (error)
-                        co_return;
-                    continue;
+                    copy.append(text);
+                }
+                else if (token)
+                {
+                    std::string().swap(copy);
+                    ListCache::Abandon(dirPath, token);
+                    token = 0;
                 }
-                sendError = true;
-                break;
             }
-            totalSent += sent;
+            last = done;
+
+            if (zstream)
+            {
+                zstream->Input(text.data(), text.size());
+                do
+                {
+                    ssize_t length = zstream->Process(last);
+                    if (length > 0)
+                        block.append((const char *)zstream->out, (size_t)length);
+                } while (zstream->Pending(last));
+            }
+            else
+            {
+                block.swap(text);
+            }
         }
 
-        if (sendError)
+        reader.Close();
+        if (readError || sendError)
+            ListCache::Abandon(dirPath, token);
+
+        if (readError)
+        {
+            sWaitSend.append("451 Failed to read directory.\r\n");
+        }
+        else if (sendError)
+        {
             sWaitSend.append("426 Connection error during transfer.\r\n");
+        }
         else
+        {
+            if (token)
+                ListCache::Store(dirPath, utf8, std::move(copy), token);
+            if (walker.Truncated())
+                sWaitSend.append("226-Listing truncated after ").append(std::to_string(entries)).append(" entries.\r\n");
             sWaitSend.append("226 Directory send OK.\r\n");
+        }
+
+        long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+        HSLL_LOGINFO(LOG_LEVEL_INFO, info.ip, ":", info.port, " Listing of ", dirPath, ": ", entries, " entries, ",
+                     total, " bytes in ", elapsed / 1000, " ms (", (elapsed ? total * 1000000 / (unsigned long long)elapsed / 1024 : 0), " KiB/s)");
 
         CloseDataConnection();
         co_return;
@@ -561,82 +1413,448 @@ namespace HSLL
         {
             tFilenames = filename;
         }
-        std::string filePath = currentDir + "/" + tFilenames;
-        sWaitSend.append("150 Opening data connection for ").append(tFilenames).append(".\r\n");
+        std::string filePath = currentDir + "/" + tFilenames;
+        off_t offset = restOffset;
+        off_t first = restOffset;
+        off_t end = restEnd;
+        off_t size = allocSize;
+        bool ranged = (restEnd >= 0);
+        bool claimed = false;
+        unsigned long long uploadId = 0;
+        int fileHandle = -1;
+        int dirHandle = -1;
+        int committed = -1;
+        int connected;
+        restOffset = 0;
+        restEnd = -1;
+        allocSize = -1;
+
+        if (ranged && size <= 0)
+        {
+            sWaitSend.append("503 ALLO required before a ranged STOR.\r\n");
+            co_return;
+        }
+
+        if (ranged && end > size)
+        {
+            sWaitSend.append("501 Byte range exceeds the allocated size.\r\n");
+            co_return;
+        }
+
+        sWaitSend.append("150 Opening data connection for ").append(tFilenames).append(".\r\n");
+
+        while (!Send())
+        {
+            co_await std::suspend_always{};
+            if (error)
+                co_return;
+        }
+
+        while ((connected = EstablishDataConnection()) == 0)
+        {
+            co_await std::suspend_always{};
+            if (error)
+                co_return;
+        }
+
+        if (connected < 0)
+        {
+            sWaitSend.append("425 Can't open data connection.\r\n");
+            co_return;
+        }
+
+        // Ranges of one file share a preallocated temporary file; a restarted upload keeps the bytes already stored
+        // A plain STOR replaces the file, so an unfinished ranged upload of it must not complete over it later
+        if (ranged)
+        {
+            fileHandle = UploadTable::Open(filePath, size, uploadId);
+        }
+        else
+        {
+            UploadTable::Drop(filePath);
+            fileHandle = open(filePath.c_str(), O_WRONLY | O_CREAT | (offset ? 0 : O_TRUNC), 0644);
+        }
+
+        if (fileHandle < 0 || (offset && lseek(fileHandle, offset, SEEK_SET) < 0))
+        {
+            int err = errno;
+            if (fileHandle >= 0)
+            {
+                if (ranged)
+                    UploadTable::Store(filePath, uploadId, first, first, false);
+                close(fileHandle);
+            }
+            sWaitSend.append(err == ENOSPC ? "552 Storage allocation exceeded.\r\n" : err == EBUSY ? "450 File is being committed.\r\n"
+                                                                                                    : "550 Failed to create file.\r\n");
+            CloseDataConnection();
+            co_return;
+        }
+        ListCache::InvalidateParent(filePath);
+
+        // The announced extent is reserved in one piece, so a full disk fails the upload before any data is sent
+        struct stat fileStat;
+        bool reserved = false;
+        off_t keptSize = 0;
+        if (!ranged && size > 0 && fstat(fileHandle, &fileStat) == 0 && fileStat.st_size < size)
+        {
+            keptSize = fileStat.st_size;
+            if (fallocate(fileHandle, 0, 0, size) == 0)
+            {
+                reserved = true;
+            }
+            else if (errno == ENOSPC || errno == EFBIG)
+            {
+                ftruncate(fileHandle, keptSize);
+                close(fileHandle);
+                sWaitSend.append("552 Storage allocation exceeded.\r\n");
+                CloseDataConnection();
+                co_return;
+            }
+        }
+
+        // Uploads announced as large bypass the page cache; writes that are not block aligned still use fileHandle
+        int directHandle = -1;
+        if (ServerInfo::directSize && size >= ServerInfo::directSize)
+            directHandle = open(("/proc/self/fd/" + std::to_string(fileHandle)).c_str(), O_WRONLY | O_DIRECT);
+
+        bool zeroCopy = (transferType == TRANSFER_TYPE_BINARY && transferMode == TRANSFER_MODE_STREAM &&
+                         !URing::Enabled() && directHandle == -1);
+        bool transform = (transferType == TRANSFER_TYPE_ASCII || transferMode == TRANSFER_MODE_DEFLATE);
+        CachePolicy cache;
+        bool cr = false;
+        bool streamEnd = false;
+        bool converting = false;
+        bool failed = false;
+        bool writing = false;
+        int current = 0;
+        size_t filled = 0;
+        const char *pendingData = nullptr;
+        size_t pendingLength = 0;
+        const char *writeData = nullptr;
+        size_t writeLength = 0;
+        int writeHandle = fileHandle;
+        ssize_t writeResult = -1;
+        off_t accepted = offset;
+        ssize_t bytesReceived = 0;
+
+        cache.Open(fileHandle, offset, size, true);
+
+        if (transferMode == TRANSFER_MODE_DEFLATE && (zstream = ZStream::Acquire(true)) == nullptr)
+        {
+            sWaitSend.append("451 Local error in processing.\r\n");
+            goto close_;
+        }
+
+        while (zeroCopy && (end < 0 || offset < end))
+        {
+            size_t chunk = (end < 0) ? HSLL_FTP_SPLICE_CHUNK : std::min((size_t)(end - offset), (size_t)HSLL_FTP_SPLICE_CHUNK);
+            ssize_t result = SpliceToFile(dataSocket, fileHandle, chunk);
+            if (result > 0)
+            {
+                offset += result;
+                cache.Advance(offset);
+                continue;
+            }
+
+            if (result == 0)
+                goto complete_;
+
+            if (result == -2)
+            {
+                sWaitSend.append("552 Storage allocation exceeded.\r\n");
+                goto close_;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                co_await WaitFor(dataSocket, EV_READ);
+                if (error)
+                    goto close_;
+            }
+            else if (errno == EINVAL)
+            {
+                zeroCopy = false;
+            }
+            else
+            {
+                sWaitSend.append("426 Connection error during transfer.\r\n");
+                goto close_;
+            }
+        }
+
+        if (!BorrowBuffers(offset, transform))
+        {
+            sWaitSend.append("451 Local error in processing.\r\n");
+            goto close_;
+        }
+
+        // Two-stage pipeline: received data fills one buffer while the disk stage writes the other. Each
+        // full buffer is stored with one large write, however small the segments it was received in.
+        // A failing data connection still drains the pipeline, so a restarted upload can resume after it
+        accepted = offset;
+        while (true)
+        {
+            // A direct upload starting mid-block first fills up to the block boundary, later buffers are aligned
+            size_t limit = ioSizes[current];
+            off_t start = accepted - (off_t)filled;
+            if (directHandle != -1 && start % HSLL_FTP_DIRECT_ALIGN)
+                limit = std::min(limit, (size_t)(HSLL_FTP_DIRECT_ALIGN - start % HSLL_FTP_DIRECT_ALIGN));
+
+            bool full = (filled == limit);
+            bool drained = failed || (streamEnd && !converting && pendingLength == 0);
+
+            // Disk stage: wait for the previous write once the network stage cannot go on without its buffer
+            if (writing && (full || drained))
+            {
+                ssize_t result = (writeResult >= 0) ? writeResult : URing::Write(diskRequest, writeHandle, writeData, writeLength, offset);
+                writeResult = -1;
+                if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    co_await std::suspend_always{};
+                    if (error)
+                        goto close_;
+                    continue;
+                }
+
+                if (result <= 0)
+                {
+                    if (!failed)
+                        sWaitSend.append("552 Storage allocation exceeded.\r\n");
+                    goto close_;
+                }
+
+                writing = false;
+                offset += result;
+                cache.Advance(offset);
+                writeData += result;
+                writeLength -= (size_t)result;
+                if (writeLength == 0)
+                    TuneBuffer(current ^ 1, offset);
+            }
+
+            // Hand a full buffer (or the tail at end of stream) over, the network stage moves to the other one
+            if (!writing && writeLength == 0 && (full || (drained && filled > 0)))
+            {
+                writeData = ioBuffers[current];
+                writeLength = filled;
+                filled = 0;
+                current ^= 1;
+            }
+
+            // Disk stage: start the write, or finish a short one
+            if (!writing && writeLength > 0)
+            {
+                bool aligned = (offset % HSLL_FTP_DIRECT_ALIGN == 0 && writeLength % HSLL_FTP_DIRECT_ALIGN == 0);
+                writeHandle = (directHandle != -1 && aligned) ? directHandle : fileHandle;
+                writeResult = URing::Write(diskRequest, writeHandle, writeData, writeLength, offset);
+                if (writeResult < 0 && errno != EAGAIN)
+                {
+                    if (!failed)
+                        sWaitSend.append("552 Storage allocation exceeded.\r\n");
+                    goto close_;
+                }
+                URing::Submit(diskRequest);
+                writing = true;
+                continue;
+            }
+
+            if (drained)
+            {
+                if (writing || writeLength > 0)
+                    continue;
+                break;
+            }
+
+            if (pendingLength > 0)
+            {
+                size_t length = std::min(pendingLength, limit - filled);
+                memcpy(ioBuffers[current] + filled, pendingData, length);
+                filled += length;
+                accepted += (off_t)length;
+                pendingData += length;
+                pendingLength -= length;
+                continue;
+            }
+
+            // Network stage: inflate and convert what was received, end of stream still makes one pass so
+            // that a CR held back by the TYPE A conversion is stored
+            if (converting)
+            {
+                const char *data = zstream ? (const char *)zstream->out : stageBuffer;
+                ssize_t length = zstream ? zstream->Process(false) : bytesReceived;
+
+                if (length < 0)
+                {
+                    sWaitSend.append("451 Invalid compressed data.\r\n");
+                    failed = true;
+                    continue;
+                }
+
+                if (transferType == TRANSFER_TYPE_ASCII)
+                {
+                    length = (ssize_t)Ascii::FromNet(data, (size_t)length, textBuffer, cr, streamEnd);
+                    data = textBuffer;
+                }
+
+                if (end >= 0 && accepted + length > end)
+                {
+                    sWaitSend.append("552 Data exceeds the byte range.\r\n");
+                    failed = true;
+                    continue;
+                }
+
+                pendingData = data;
+                pendingLength = (size_t)length;
+                converting = zstream && zstream->Pending(false);
+                continue;
+            }
+
+            // Network stage: receive, straight into the pipeline buffer when nothing is converted
+            char *target = transform ? stageBuffer : ioBuffers[current] + filled;
+            size_t want = transform ? (size_t)HSLL_FTP_STAGE_SIZE : limit - filled;
+
+            // At the end of a byte range one more byte is requested to tell end of stream from overrun
+            if (end >= 0 && !transform && end - accepted < (off_t)want)
+                want = (end > accepted) ? (size_t)(end - accepted) : 1;
+
+            bytesReceived = URing::Recv(ioRequest, dataSocket, target, want);
+            if (bytesReceived < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    co_await WaitFor(dataSocket, EV_READ);
+                    if (error)
+                        goto close_;
+                    continue;
+                }
+                else
+                {
+                    sWaitSend.append("426 Connection error during transfer.\r\n");
+                    failed = true;
+                    continue;
+                }
+            }
+
+            if (bytesReceived == 0)
+            {
+                streamEnd = true;
+                if (zstream && !zstream->Finished())
+                {
+                    sWaitSend.append("451 Compressed data truncated.\r\n");
+                    failed = true;
+                    continue;
+                }
+            }
+
+            if (transform)
+            {
+                if (zstream)
+                    zstream->Input(stageBuffer, (size_t)bytesReceived);
+                converting = true;
+                continue;
+            }
+
+            if (end >= 0 && accepted + bytesReceived > end)
+            {
+                sWaitSend.append("552 Data exceeds the byte range.\r\n");
+                failed = true;
+                continue;
+            }
+
+            filled += (size_t)bytesReceived;
+            accepted += bytesReceived;
+        }
 
-        while (!Send())
+        if (failed)
+            goto close_;
+
+    complete_:
+        // A range completing the file claims its commit, so no writer is left when the file is flushed below
+        if (ranged)
         {
-            co_await std::suspend_always{};
-            if (error)
-                co_return;
+            ranged = false;
+            committed = UploadTable::Store(filePath, uploadId, first, offset, true);
+            if (committed < 0)
+            {
+                sWaitSend.append("451 Failed to commit file.\r\n");
+                goto close_;
+            }
+            claimed = (committed == 1);
         }
 
-        if (!EstablishDataConnection())
+        // The data joins the next group commit and the transfer is only reported once it is on disk
+        if (GroupCommit::Enabled())
         {
-            sWaitSend.append("425 Can't open data connection.\r\n");
-            co_return;
+            while (GroupCommit::Sync(diskRequest, fileHandle) != 0)
+            {
+                if (errno != EAGAIN)
+                {
+                    sWaitSend.append("451 Failed to write file to disk.\r\n");
+                    goto close_;
+                }
+
+                co_await std::suspend_always{};
+                if (error)
+                    goto close_;
+            }
         }
 
-        int fileHandle = open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fileHandle < 0)
+        if (committed == 0)
         {
-            sWaitSend.append("550 Failed to create file.\r\n");
-            CloseDataConnection();
-            co_return;
+            sWaitSend.append("226 Byte range stored.\r\n");
+            goto close_;
         }
 
-        char buffer[8192];
-        ssize_t bytesReceived;
-        bool timeoutOccurred = false;
-        while (true)
+        if (claimed)
         {
-            bytesReceived = recv(dataSocket, buffer, sizeof(buffer), 0);
-            if (bytesReceived > 0)
+            claimed = false;
+            if (!UploadTable::Finish(filePath, uploadId, true))
             {
-                ssize_t bytesWritten = 0;
+                sWaitSend.append("451 Failed to commit file.\r\n");
+                goto close_;
+            }
 
-                while (bytesWritten < bytesReceived)
+            // The rename of the completed file only persists once its directory is flushed as well
+            if (GroupCommit::Enabled())
+            {
+                dirHandle = open(filePath.substr(0, filePath.find_last_of('/')).c_str(), O_RDONLY | O_DIRECTORY);
+                while (dirHandle < 0 || GroupCommit::Sync(diskRequest, dirHandle) != 0)
                 {
-                    ssize_t result = write(fileHandle, buffer + bytesWritten, (size_t)(bytesReceived - bytesWritten));
-                    if (result > 0)
-                    {
-                        bytesWritten += result;
-                    }
-                    else if (result < 0)
+                    if (dirHandle < 0 || errno != EAGAIN)
                     {
-                        sWaitSend.append("552 Storage allocation exceeded.\r\n");
+                        sWaitSend.append("451 Failed to write file to disk.\r\n");
                         goto close_;
                     }
-                }
-            }
-            else if (bytesReceived == 0)
-            {
-                break;
-            }
-            else if (bytesReceived < 0)
-            {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
-                {
+
                     co_await std::suspend_always{};
                     if (error)
-                    {
-                        close(fileHandle);
-                        co_return;
-                    }
-                    continue;
-                }
-                else
-                {
-                    sWaitSend.append("426 Connection error during transfer.\r\n");
-                    goto close_;
+                        goto close_;
                 }
             }
         }
-
         sWaitSend.append("226 Transfer complete.\r\n");
 
     close_:
+        // A block still being written refers to the pipeline buffers and the file, even after an error
+        while (URing::Pending(diskRequest))
+            co_await std::suspend_always{};
+        URing::Discard(diskRequest);
+        // A failed range is only recorded, and a claimed commit is handed back for the next range to complete
+        if (ranged)
+            UploadTable::Store(filePath, uploadId, first, offset, false);
+        if (claimed)
+            UploadTable::Finish(filePath, uploadId, false);
+        if (dirHandle != -1)
+            close(dirHandle);
+
+        // An upload that ended short of its reservation is trimmed to the data actually stored
+        if (reserved && std::max(offset, keptSize) < size)
+            ftruncate(fileHandle, std::max(offset, keptSize));
+        cache.Finish(offset);
+        if (directHandle != -1)
+            close(directHandle);
         close(fileHandle);
+        ListCache::InvalidateParent(filePath);
         CloseDataConnection();
         co_return;
     }
@@ -644,14 +1862,22 @@ namespace HSLL
     Generator<START_FLAG::START_FLAG_NOSUSPEND> FTPServer::HandleDownload(const std::string &filename)
     {
         std::string filePath = currentDir + "/" + filename;
+        off_t offset = restOffset;
+        off_t end = restEnd;
+        int connected;
+        restOffset = 0;
+        restEnd = -1;
 
         struct stat statbuf;
-        if (stat(filePath.c_str(), &statbuf) || !S_ISREG(statbuf.st_mode))
+        if (!FindSized(filePath, statbuf) && (stat(filePath.c_str(), &statbuf) || !S_ISREG(statbuf.st_mode)))
         {
             sWaitSend.append("550 File not found.\r\n");
             co_return;
         }
 
+        if (end < 0 || end > statbuf.st_size)
+            end = statbuf.st_size;
+
         sWaitSend.append("150 Opening data connection for ").append(filename).append(".\r\n");
 
         while (!Send())
@@ -661,13 +1887,23 @@ namespace HSLL
                 co_return;
         }
 
-        if (!EstablishDataConnection())
+        while ((connected = EstablishDataConnection()) == 0)
+        {
+            co_await std::suspend_always{};
+            if (error)
+                co_return;
+        }
+
+        if (connected < 0)
         {
             sWaitSend.append("425 Can't open data connection.\r\n");
             co_return;
         }
 
-        int fileHandle = open(filePath.c_str(), O_RDONLY);
+        // A file opened by the preceding SIZE is read through its descriptor
+        int fileHandle = TakeSized(filePath);
+        if (fileHandle < 0)
+            fileHandle = open(filePath.c_str(), O_RDONLY);
         if (fileHandle < 0)
         {
             sWaitSend.append("550 Failed to open file.\r\n");
@@ -675,43 +1911,174 @@ namespace HSLL
             co_return;
         }
 
-        char buffer[8192];
-        ssize_t bytesRead;
-        while ((bytesRead = read(fileHandle, buffer, sizeof(buffer))) > 0)
+        bool zeroCopy = (transferType == TRANSFER_TYPE_BINARY && transferMode == TRANSFER_MODE_STREAM && !URing::Enabled());
+        CachePolicy cache;
+        bool cr = false;
+        bool reading = false;
+        int current = 0;
+        const char *block = nullptr;
+        size_t blockLength = 0;
+        size_t readLength = 0;
+        ssize_t readResult = -1;
+        ssize_t bytesRead = 0;
+
+        cache.Open(fileHandle, offset, statbuf.st_size, false);
+
+        if (transferMode == TRANSFER_MODE_DEFLATE && (zstream = ZStream::Acquire(false)) == nullptr)
+        {
+            sWaitSend.append("451 Local error in processing.\r\n");
+            goto close_;
+        }
+
+        while (zeroCopy && offset < end)
+        {
+            size_t chunk = std::min((size_t)(end - offset), (size_t)HSLL_FTP_SENDFILE_CHUNK);
+            ssize_t result = sendfile(dataSocket, fileHandle, &offset, chunk);
+            if (result > 0)
+            {
+                cache.Advance(offset);
+                continue;
+            }
+
+            if (result == 0)
+                break;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                co_await WaitFor(dataSocket, EV_WRITE);
+                if (error)
+                    goto close_;
+            }
+            else if (errno == EINVAL || errno == ENOSYS)
+            {
+                zeroCopy = false;
+            }
+            else
+            {
+                sWaitSend.append("426 Connection error during transfer.\r\n");
+                goto close_;
+            }
+        }
+
+        if (zeroCopy)
+            goto complete_;
+
+        if (!BorrowBuffers(offset, false))
         {
-            size_t bytesSent = 0;
+            sWaitSend.append("451 Local error in processing.\r\n");
+            goto close_;
+        }
 
-            while (bytesSent < bytesRead)
+        // Two-stage pipeline: the disk stage reads the next block into the idle buffer while the previous one is sent
+        while (true)
+        {
+            if (!reading && offset < end)
             {
-                ssize_t result = send(dataSocket, buffer + bytesSent, (size_t)(bytesRead - bytesSent), 0);
-                if (result > 0)
+                TuneBuffer(current, offset);
+                readLength = std::min((size_t)(end - offset), ioSizes[current]);
+                readResult = URing::Read(diskRequest, fileHandle, ioBuffers[current], readLength, offset);
+                if (readResult < 0 && errno != EAGAIN)
                 {
-                    bytesSent += result;
+                    sWaitSend.append("451 Local error in processing.\r\n");
+                    goto close_;
                 }
-                else if (result < 0)
+                URing::Submit(diskRequest);
+                reading = true;
+            }
+
+            if (block != nullptr)
+            {
+                if (transferType == TRANSFER_TYPE_ASCII)
                 {
-                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    blockLength = Ascii::ToNet(block, blockLength, textBuffer, cr);
+                    block = textBuffer;
+                }
+
+                if (zstream)
+                    zstream->Input(block, blockLength);
+
+                do
+                {
+                    const char *data = zstream ? (const char *)zstream->out : block;
+                    ssize_t length = zstream ? zstream->Process(bytesRead == 0) : (ssize_t)blockLength;
+                    ssize_t bytesSent = 0;
+
+                    if (length < 0)
                     {
-                        co_await std::suspend_always{};
-                        if (error)
+                        sWaitSend.append("451 Local error in processing.\r\n");
+                        goto close_;
+                    }
+
+                    while (bytesSent < length)
+                    {
+                        ssize_t result = URing::Send(ioRequest, dataSocket, data + bytesSent, (size_t)(length - bytesSent));
+                        if (result > 0)
                         {
-                            close(fileHandle);
-                            co_return;
+                            bytesSent += result;
+                        }
+                        else if (result < 0)
+                        {
+                            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                            {
+                                co_await WaitFor(dataSocket, EV_WRITE);
+                                if (error)
+                                    goto close_;
+                                continue;
+                            }
+                            else
+                            {
+                                sWaitSend.append("426 Connection error during transfer.\r\n");
+                                goto close_;
+                            }
                         }
-                        continue;
                     }
-                    else
+                } while (zstream && zstream->Pending(bytesRead == 0));
+
+                if (bytesRead == 0)
+                    break;
+                block = nullptr;
+            }
+
+            bytesRead = 0;
+            if (reading)
+            {
+                bytesRead = (readResult >= 0) ? readResult : URing::Read(diskRequest, fileHandle, ioBuffers[current], readLength, offset);
+                if (bytesRead < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
                     {
-                        sWaitSend.append("426 Connection error during transfer.\r\n");
-                        goto close_;
+                        co_await std::suspend_always{};
+                        if (error)
+                            goto close_;
+                        continue;
                     }
+                    sWaitSend.append("451 Local error in processing.\r\n");
+                    goto close_;
                 }
+                reading = false;
+                readResult = -1;
+                offset += bytesRead;
+                cache.Advance(offset);
             }
+
+            // At end of file a compressed transfer still has to terminate the deflate stream
+            if (bytesRead == 0 && zstream == nullptr)
+                break;
+
+            block = ioBuffers[current];
+            blockLength = (size_t)bytesRead;
+            current ^= 1;
         }
 
+    complete_:
         sWaitSend.append("226 Transfer complete.\r\n");
 
     close_:
+        // A block read ahead still refers to the pipeline buffers and the file, even after an error
+        while (URing::Pending(diskRequest))
+            co_await std::suspend_always{};
+        URing::Discard(diskRequest);
+        cache.Finish(offset);
         close(fileHandle);
         CloseDataConnection();
         co_return;
@@ -804,10 +2171,11 @@ namespace HSLL
             }
             else if (cmd == "FEAT")
             {
-                sWaitSend.append("211-Features:\r\n PASV\r\n SIZE\r\n");
+                sWaitSend.append("211-Features:\r\n PASV\r\n SIZE\r\n REST STREAM\r\n RANG STREAM\r\n MODE Z\r\n"
+                                 " MLST type*;size*;modify*;perm*;unique*;\r\n");
                 if (ServerInfo::utf8)
-                    sWaitParse.append(" UTF8\r\n OPTS UTF8\r\n");
-                sWaitSend.append(" 211 End\r\n");
+                    sWaitSend.append(" UTF8\r\n OPTS UTF8\r\n");
+                sWaitSend.append("211 End\r\n");
             }
             else if (cmd == "QUIT")
             {
@@ -817,17 +2185,40 @@ namespace HSLL
             {
                 sWaitSend.append("200 NOOP ok\r\n");
             }
+            else if (cmd == "MLST")
+            {
+                HandleMLST(param);
+            }
+            else if (cmd == "STAT")
+            {
+                sWaitSend.append("211-Server status:\r\n Page cache prefetched: ")
+                    .append(std::to_string(CachePolicy::Prefetched()))
+                    .append(" bytes\r\n Page cache dropped: ")
+                    .append(std::to_string(CachePolicy::Dropped()))
+                    .append(" bytes\r\n Listing cache hits: ")
+                    .append(std::to_string(ListCache::Hits()))
+                    .append("\r\n Listing cache misses: ")
+                    .append(std::to_string(ListCache::Misses()))
+                    .append("\r\n Listing prefetches: ")
+                    .append(std::to_string(ListCache::Prefetched()))
+                    .append(", used: ")
+                    .append(std::to_string(ListCache::PrefetchHits()))
+                    .append(", wasted: ")
+                    .append(std::to_string(ListCache::PrefetchWasted()))
+                    .append("\r\n211 End of status.\r\n");
+            }
             else if (cmd == "TYPE")
             {
+                transferType = TRANSFER_TYPE_BINARY;
                 sWaitSend.append("200 Type set to I\r\n");
             }
             else if (cmd == "PASV")
             {
                 HandlePASV();
             }
-            else if (cmd == "LIST" || cmd == "NLST")
+            else if (cmd == "LIST" || cmd == "NLST" || cmd == "MLSD")
             {
-                task = HandleList();
+                task = HandleList((cmd == "LIST") ? LIST_STYLE_LONG : (cmd == "NLST") ? LIST_STYLE_NAMES : LIST_STYLE_FACTS, param);
                 if (!task.hasDone())
                     return false;
                 task.Destroy();
@@ -848,6 +2239,10 @@ namespace HSLL
                     closedir(dir);
                     currentDir = targetDir;
                     sWaitSend.append("250 Directory changed to " + targetDir + ".\r\n");
+
+                    // Clients usually list the directory next; its listing is built while the data connection is set up
+                    ListCache::Cancel(prefetch);
+                    prefetch = ListCache::Prefetch(currentDir, utf8);
                 }
                 else
                 {
@@ -859,6 +2254,7 @@ namespace HSLL
                 std::string dirPath = currentDir + "/" + param;
                 if (rmdir(dirPath.c_str()) == 0)
                 {
+                    ListCache::InvalidateParent(dirPath);
                     sWaitSend.append("250 Directory removed.\r\n");
                 }
                 else
@@ -870,6 +2266,7 @@ namespace HSLL
             {
                 if (param == "A" || param == "I")
                 {
+                    transferType = (param == "I") ? TRANSFER_TYPE_BINARY : TRANSFER_TYPE_ASCII;
                     sWaitSend.append("200 Type set to ").append(param).append("\r\n");
                 }
                 else
@@ -877,6 +2274,19 @@ namespace HSLL
                     sWaitSend.append("504 Invalid type.\r\n");
                 }
             }
+            else if (cmd == "MODE")
+            {
+                std::string mode = ToUpperCase(param);
+                if (mode == "S" || mode == "Z")
+                {
+                    transferMode = (mode == "Z") ? TRANSFER_MODE_DEFLATE : TRANSFER_MODE_STREAM;
+                    sWaitSend.append("200 Mode set to ").append(mode).append(".\r\n");
+                }
+                else
+                {
+                    sWaitSend.append("504 Unsupported mode.\r\n");
+                }
+            }
             else if (cmd == "PORT")
             {
                 HandlePORT(param);
@@ -885,7 +2295,28 @@ namespace HSLL
             {
                 std::string filePath = currentDir + "/" + param;
                 struct stat statbuf;
-                if (stat(filePath.c_str(), &statbuf) == 0)
+                DropSized();
+
+                // Clients usually download a file right after sizing it; its head is read ahead and the
+                // open file is kept for the RETR
+                int fd = ServerInfo::sizeReadahead ? open(filePath.c_str(), O_RDONLY) : -1;
+                if (fd >= 0)
+                {
+                    if (fstat(fd, &statbuf) == 0 && S_ISREG(statbuf.st_mode))
+                    {
+                        CachePolicy::Prefetch(fd, std::min(statbuf.st_size, ServerInfo::sizeReadahead));
+                        sizedPath = filePath;
+                        sizedFd = fd;
+                        sizedStat = statbuf;
+                        sizedTime = std::chrono::steady_clock::now();
+                    }
+                    else
+                    {
+                        close(fd);
+                    }
+                }
+
+                if (sizedFd >= 0 || stat(filePath.c_str(), &statbuf) == 0)
                 {
                     sWaitSend.append("213 ").append(std::to_string((long long)statbuf.st_size)).append("\r\n");
                 }
@@ -919,6 +2350,10 @@ namespace HSLL
                     std::string filePath = currentDir + "/" + param;
                     if (rename(renameFromPath.c_str(), filePath.c_str()) == 0)
                     {
+                        DropSized();
+                        UploadTable::Drop(filePath);
+                        ListCache::InvalidateParent(renameFromPath);
+                        ListCache::InvalidateParent(filePath);
                         sWaitSend.append("250 Rename ok.\r\n");
                     }
                     else
@@ -933,6 +2368,9 @@ namespace HSLL
                 std::string filePath = currentDir + "/" + param;
                 if (remove(filePath.c_str()) == 0)
                 {
+                    DropSized();
+                    UploadTable::Drop(filePath);
+                    ListCache::InvalidateParent(filePath);
                     sWaitSend.append("250 File deleted.\r\n");
                 }
                 else
@@ -940,6 +2378,81 @@ namespace HSLL
                     sWaitSend.append("550 Delete failed.\r\n");
                 }
             }
+            else if (cmd == "REST")
+            {
+                size_t pos = 0;
+                unsigned long long num = 0;
+
+                try
+                {
+                    if (isdigit((unsigned char)param[0]))
+                        num = std::stoull(param, &pos);
+                }
+                catch (...)
+                {
+                    pos = 0;
+                }
+
+                if (pos == param.size() && num <= (unsigned long long)LLONG_MAX)
+                {
+                    restOffset = (off_t)num;
+                    restEnd = -1;
+                    sWaitSend.append("350 Restart position accepted (").append(param).append(").\r\n");
+                }
+                else
+                {
+                    sWaitSend.append("501 Invalid restart position.\r\n");
+                }
+            }
+            else if (cmd == "ALLO")
+            {
+                size_t pos = 0;
+                unsigned long long num = 0;
+
+                try
+                {
+                    if (isdigit((unsigned char)param[0]))
+                        num = std::stoull(param, &pos);
+                }
+                catch (...)
+                {
+                    pos = 0;
+                }
+
+                // The optional record size ("R <size>") has no meaning for stream mode and is ignored
+                if (pos != 0 && (pos == param.size() || param[pos] == ' ') && num <= (unsigned long long)LLONG_MAX)
+                {
+                    allocSize = (off_t)num;
+                    sWaitSend.append("200 ALLO command successful.\r\n");
+                }
+                else
+                {
+                    sWaitSend.append("501 Invalid allocation size.\r\n");
+                }
+            }
+            else if (cmd == "RANG")
+            {
+                unsigned long long first = 0, last = 0;
+                char tail;
+
+                if (sscanf(param.c_str(), "%llu %llu%c", &first, &last, &tail) != 2 || !isdigit((unsigned char)param[0]) ||
+                    last > (unsigned long long)LLONG_MAX - 1 || (last < first && !(first == 1 && last == 0)))
+                {
+                    sWaitSend.append("501 Invalid byte range.\r\n");
+                }
+                else if (first == 1 && last == 0)
+                {
+                    restOffset = 0;
+                    restEnd = -1;
+                    sWaitSend.append("350 Restarting at 0. End of file.\r\n");
+                }
+                else
+                {
+                    restOffset = (off_t)first;
+                    restEnd = (off_t)last + 1;
+                    sWaitSend.append("350 Restarting at ").append(std::to_string(first)).append(". Ending at ").append(std::to_string(last)).append(".\r\n");
+                }
+            }
             else if (cmd == "RETR")
             {
                 task = HandleDownload(param);
@@ -949,16 +2462,42 @@ namespace HSLL
             }
             else if (cmd == "STOR")
             {
+                DropSized();
                 task = HandleUpload(param);
                 if (!task.hasDone())
                     return false;
                 task.Destroy();
             }
+            else if (cmd == "LIST")
+            {
+                std::string target;
+                bool recursive = ParseListOptions(param, target);
+                task = HandleList(recursive ? LIST_STYLE_TREE : LIST_STYLE_LONG, target);
+                if (!task.hasDone())
+                    return false;
+                task.Destroy();
+            }
+            else if (cmd == "STAT")
+            {
+                HandleSTAT(param);
+            }
+            else if (cmd == "NLST" || cmd == "MLSD")
+            {
+                task = HandleList((cmd == "NLST") ? LIST_STYLE_NAMES : LIST_STYLE_FACTS, param);
+                if (!task.hasDone())
+                    return false;
+                task.Destroy();
+            }
+            else if (cmd == "MLST")
+            {
+                HandleMLST(param);
+            }
             else if (cmd == "MKD" || cmd == "XMKD")
             {
                 std::string dirPath = currentDir + "/" + param;
                 if (mkdir(dirPath.c_str(), 0755) == 0)
                 {
+                    ListCache::InvalidateParent(dirPath);
                     sWaitSend.append("257 \"").append(param).append("\" created.\r\n");
                 }
                 else
@@ -992,20 +2531,118 @@ namespace HSLL
         return true;
     }
 
+    void FTPServer::Park()
+    {
+        while (true)
+        {
+            bool waiting = false;
+
+            // Events stay disabled while parked, so replies queued by the coroutine are written here;
+            // the session is only published as free by the CAS to WAKE_PARKED or by EnableRW()
+            evb.Flush();
+
+            if (URing::Pending(ioRequest))
+            {
+                waitFd = -1;
+                waiting = URing::Submit(ioRequest);
+            }
+            else if (waitFd != -1)
+            {
+                int fd = waitFd;
+                waitFd = -1;
+                waiting = (watcher.Watch(fd, waitEvents, ServerInfo::rwtimeout) == 0);
+            }
+
+            // The pipeline's file operation resumes the transfer as well
+            if (URing::Pending(diskRequest))
+                waiting = URing::Submit(diskRequest) || waiting;
+
+            if (waiting)
+            {
+                int running = WAKE_RUNNING;
+                if (wakeState.compare_exchange_strong(running, WAKE_PARKED))
+                    return;
+            }
+            else if (!URing::Done(ioRequest) && !URing::Done(diskRequest))
+            {
+                EnableRW();
+                return;
+            }
+
+            // Something completed before the session was parked, keep running the task on this thread;
+            // the session was never published as free, so the disconnection is still waiting for it
+            wakeState = WAKE_RUNNING;
+            watcher.Cancel();
+
+            if (DealTask())
+            {
+                Send_And_EnableWR();
+                return;
+            }
+        }
+    }
+
+    bool FTPServer::Wake(short events)
+    {
+        if (wakeState.exchange(WAKE_NOTIFIED) != WAKE_PARKED)
+            return false;
+
+        wakeState = WAKE_RUNNING;
+        watcher.Cancel();
+        if (events & EV_TIMEOUT)
+            WaitTimeout();
+        return true;
+    }
+
+    void FTPServer::WaitTimeout()
+    {
+        // A data connection that never shows up fails the command; a stalled transfer drops the session
+        if (connecting)
+        {
+            waitExpired = true;
+            return;
+        }
+
+        error = true;
+        sWaitSend.append("421 Data connection timed out.\r\n");
+    }
+
     void FTPServer::DealRead()
     {
         Read();
         if (!DealTask())
+        {
+            Park();
             return;
+        }
         if (!Parse())
             error = true;
-        Send_And_EnableWR();
+        if (!task.HandleInvalid())
+        {
+            Send_And_EnableWR();
+            return;
+        }
+        Send();
+        Park();
     }
 
     void FTPServer::DealWrite()
     {
         if (!DealTask())
+        {
+            Park();
+            return;
+        }
+        Send_And_EnableWR();
+    }
+
+    void FTPServer::DealResume()
+    {
+        if (!DealTask())
+        {
+            Park();
             return;
+        }
         Send_And_EnableWR();
     }
 
@@ -1036,7 +2673,7 @@ namespace HSLL
 
     bool FTPServer::CheakFree()
     {
-        return enableFree;
+        return enableFree || wakeState.load() == WAKE_PARKED;
     }
 
     bool FTPServer::CheakError()
@@ -1098,27 +2735,56 @@ namespace HSLL
         return (sWaitParse.size() <= 1024);
     }
 
-    FTPServer::FTPServer(EVBuffer evb, ConnectionInfo info) : evb(evb),
-                                                              info(info),
-                                                              enableFree(true),
-                                                              certified(false),
-                                                              utf8(false),
-                                                              error(false),
-                                                              dataSocket(-1),
-                                                              pasvSocket(-1),
-                                                              dataMode(DATA_MODE_NONE),
-                                                              currentDir(ServerInfo::dir)
+    FTPServer::FTPServer(EVBuffer evb, ConnectionInfo info, WatchProc ready) : evb(evb),
+                                                                               info(info),
+                                                                               enableFree(true),
+                                                                               certified(false),
+                                                                               utf8(false),
+                                                                               error(false),
+                                                                               currentDir(ServerInfo::dir),
+                                                                               dataSocket(-1),
+                                                                               pasvSocket(-1),
+                                                                               pasvPort(0),
+                                                                               restOffset(0),
+                                                                               restEnd(-1),
+                                                                               allocSize(-1),
+                                                                               dataMode(DATA_MODE_NONE),
+                                                                               transferType(TRANSFER_TYPE_BINARY),
+                                                                               transferMode(TRANSFER_MODE_STREAM),
+                                                                               zstream(nullptr),
+                                                                               ioBuffers{nullptr, nullptr},
+                                                                               textBuffer(nullptr),
+                                                                               stageBuffer(nullptr),
+                                                                               ioSizes{0, 0},
+                                                                               textBufferSize(0),
+                                                                               bufferHint(HSLL_BUFFER_MIN),
+                                                                               ratePosition(0),
+                                                                               sizedFd(-1),
+                                                                               ioRequest(this),
+                                                                               diskRequest(this),
+                                                                               wakeState(WAKE_RUNNING),
+                                                                               watcher(ready, this),
+                                                                               waitFd(-1),
+                                                                               waitEvents(0),
+                                                                               connecting(false),
+                                                                               waitExpired(false)
     {
     }
 
     FTPServer::~FTPServer()
     {
         error = true;
+        watcher.Cancel();
+        ListCache::Cancel(prefetch);
+        URing::Cancel(ioRequest);
+        GroupCommit::Cancel(diskRequest);
+        URing::Cancel(diskRequest);
         if (task.HandleInvalid())
         {
             task.Resume();
             task.Destroy();
         }
         CloseDataConnection();
+        DropSized();
     }
 }
\ No newline at end of file
@@ -7,15 +7,73 @@
 #define HSLL_FTPSERVER
 
 #include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <cstring>
 #include <errno.h>
 #include <sys/stat.h>
 
 #include "../Event/Eventcplus.h"
+#include "../Uring/Uring.h"
+#include "../PortPool/PortPool.h"
+#include "../Compress/Compress.h"
+#include "../Ascii/Ascii.h"
+#include "../BufferPool/BufferPool.h"
+#include "../Cache/Cache.h"
+#include "../Commit/Commit.h"
+#include "../ListCache/ListCache.h"
+#include "../Listing/Listing.h"
 #include "../ThreadPool/ThreadPool.hpp"
 #include "../Coroutine/Coroutine.hpp"
 
+/**
+ * @brief Maximum number of bytes handed to a single sendfile() call
+ * @details Large chunks keep the per-syscall overhead negligible on multi-GB downloads
+ */
+#define HSLL_FTP_SENDFILE_CHUNK (4 * 1024 * 1024)
+
+/**
+ * @brief Maximum number of bytes moved by one socket-to-file splice() round
+ * @details Also requested as the capacity of each worker's splice pipe
+ */
+#define HSLL_FTP_SPLICE_CHUNK (1024 * 1024)
+
+/**
+ * @brief Largest pipeline block of a TYPE A transfer
+ * @details The conversion buffer is sized for the expansion of one such block
+ */
+#define HSLL_FTP_TEXT_BLOCK (256 * 1024)
+
+/**
+ * @brief File offset and length alignment of O_DIRECT writes
+ * @details Pool buffers are page aligned, so only offsets and lengths are checked
+ */
+#define HSLL_FTP_DIRECT_ALIGN 4096
+
+/**
+ * @brief Formatted bytes of a directory listing produced and sent at a time
+ */
+#define HSLL_FTP_LIST_CHUNK (64 * 1024)
+
+/**
+ * @brief Maximum number of entries STAT lists on the control connection
+ * @details The reply is built in one piece while the session waits, so longer listings are left to LIST -R
+ */
+#define HSLL_FTP_STAT_ENTRIES 10000
+
+/**
+ * @brief Seconds a file opened by SIZE is kept for the following RETR
+ */
+#define HSLL_FTP_SIZED_TTL 5
+
+/**
+ * @brief Receive buffer size of uploads that are converted or inflated before being stored
+ */
+#define HSLL_FTP_STAGE_SIZE HSLL_BUFFER_MIN
+
 namespace HSLL
 {
     /**
@@ -26,8 +84,23 @@ namespace HSLL
     {
         static bool utf8;                                           //!< Whether UTF-8 is supported
         static bool anonymous;                                      //!< Anonymous access enable flag
+        static bool uring;                                          //!< Whether data transfers use io_uring
         static unsigned int rwtimeout;                              //!< I/O timeout in seconds
         static unsigned short port;                                 //!< Server listening port
+        static unsigned short pasvLow;                              //!< First passive port, 0 for ephemeral ports
+        static unsigned short pasvHigh;                             //!< Last passive port
+        static int deflateLevel;                                    //!< MODE Z compression level (0-9)
+        static bool hugepages;                                      //!< Whether transfer buffers use huge pages
+        static off_t cacheDropSize;                                 //!< Files this large leave the page cache behind transfers
+        static off_t directSize;                                    //!< ALLO size from which uploads use O_DIRECT, 0 for never
+        static unsigned int uploadTTL;                              //!< Seconds an idle ranged upload is kept
+        static COMMIT_MODE durability;                              //!< How completed uploads are flushed before 226
+        static unsigned int commitWindow;                           //!< Group commit batching window in milliseconds
+        static size_t listCacheSize;                                //!< Memory budget of the listing cache, 0 for none
+        static size_t prefetchSize;                                 //!< Largest listing prefetched on CWD, 0 for none
+        static off_t sizeReadahead;                                 //!< Head of a file prefetched on SIZE, 0 for none
+        static int treeDepth;                                       //!< Deepest level of recursive listings
+        static size_t treeEntries;                                  //!< Maximum number of entries of a recursive listing
         static char dir[1024];                                      //!< Root directory path
         static char ip[INET_ADDRSTRLEN];                            //!< Server IP address string
         static char encoding[32];                                   //!< The current system character encoding
@@ -41,6 +114,87 @@ namespace HSLL
         static bool LoadConfig(const char *configPath);
     };
 
+    /**
+     * @brief Convert a string between character encodings
+     * @param input Text to convert
+     * @param fromEncoding Encoding of input
+     * @param toEncoding Encoding of the result
+     * @return Converted text, or input unchanged if the conversion fails
+     */
+    std::string convertEncoding(const std::string &input, const std::string &fromEncoding, const std::string &toEncoding);
+
+    /**
+     * @brief Shared state of ranged (parallel) uploads
+     * @details Sessions storing byte ranges of the same file write into one temporary file preallocated
+     *          to the ALLO size. Stored ranges are merged per target, and the temporary file is renamed
+     *          over the target once they cover the whole file. An upload no session has written to for
+     *          uploadTTL seconds is abandoned and its temporary file removed
+     */
+    class UploadTable
+    {
+    private:
+        struct Entry
+        {
+            std::string tempPath;                          //!< Preallocated temporary file next to the target
+            off_t size;                                    //!< Announced file size
+            off_t stored;                                  //!< Bytes covered by stored ranges
+            std::map<off_t, off_t> ranges;                 //!< Disjoint stored ranges (first -> end, exclusive)
+            unsigned long long id;                         //!< Identifies this upload among reuses of the path
+            int writers;                                   //!< Sessions currently storing a range
+            bool committing;                               //!< A session claimed the completed file and is committing it
+            std::chrono::steady_clock::time_point touched; //!< Time the last range was opened or stored
+        };
+
+        static std::mutex mtx;                       //!< Protects the table
+        static std::map<std::string, Entry> entries; //!< Uploads in progress by target path
+        static unsigned long long ids;               //!< Last assigned upload id
+
+        /**
+         * @brief Remove an upload and its temporary file
+         */
+        static void Erase(std::map<std::string, Entry>::iterator it);
+
+    public:
+        /**
+         * @brief Open the temporary file of a ranged upload, creating and preallocating it if needed
+         * @details Abandoned uploads are removed first, so an expired entry is replaced rather than joined
+         * @param path Target file path
+         * @param size Announced file size
+         * @param id Receives the id of the upload, passed back to Store
+         * @return Writable descriptor, or -1 on failure (errno set, EINVAL on a size mismatch, EBUSY while committing)
+         */
+        static int Open(const std::string &path, off_t size, unsigned long long &id);
+
+        /**
+         * @brief Record a stored byte range and claim the commit of the file once it is complete
+         * @details Ends the range opened by Open; called once per successful Open, also after a failure.
+         *          Only a successful range with no other writer left claims the commit, so a file completed
+         *          by a failed range waits for the next successful one
+         * @param path Target file path
+         * @param id Id returned by Open
+         * @param first First byte of the range
+         * @param end End of the range (exclusive)
+         * @param success Whether the range was transferred successfully
+         * @return 1 if the caller must now Finish the file, 0 if it is not ready, -1 if the upload is gone
+         */
+        static int Store(const std::string &path, unsigned long long id, off_t first, off_t end, bool success);
+
+        /**
+         * @brief End a commit claimed by Store
+         * @param path Target file path
+         * @param id Id returned by Open
+         * @param commit Rename the flushed file into place, or give the claim back after a failure
+         * @return true if the file was renamed (always false when giving the claim back)
+         */
+        static bool Finish(const std::string &path, unsigned long long id, bool commit);
+
+        /**
+         * @brief Abandon the ranged upload of a path that is replaced, removed or renamed over
+         * @param path Target file path
+         */
+        static void Drop(const std::string &path);
+    };
+
     /**
      * @brief Main FTP server implementation class
      * @details Handles client connections, command processing, and data transfers
@@ -52,8 +206,9 @@ namespace HSLL
          * @brief Constructor with event buffer
          * @param evb Initialized event buffer for network operations
          * @param info Connection information structure
+         * @param ready Callback invoked on the event loop when a parked transfer's socket is ready
          */
-        FTPServer(EVBuffer evb, ConnectionInfo info);
+        FTPServer(EVBuffer evb, ConnectionInfo info, WatchProc ready);
 
         ~FTPServer();
 
@@ -75,6 +230,28 @@ namespace HSLL
          */
         void DealAccept();
 
+        /**
+         * @brief Handle completion of the operation a parked transfer is waiting for
+         * @details Resumes the transfer coroutine
+         */
+        void DealResume();
+
+        /**
+         * @brief Claim the resumption of a parked transfer
+         * @details Called on the event loop for every completion and readiness event. Events that
+         *          arrive while the transfer is running only leave a note for Park()
+         * @param events Triggered event flags (EV_TIMEOUT marks the wait as timed out), 0 for completions
+         * @return true if the caller must queue the resume task
+         */
+        bool Wake(short events);
+
+        /**
+         * @brief Mark the parked transfer's wait as timed out
+         * @details A pending accept/connect fails the command with 425; a stalled transfer queues
+         *          a 421 reply and flags the session for closing. Called on the event loop
+         */
+        void WaitTimeout();
+
         /**
          * @brief Send buffered data and enable write monitoring
          */
@@ -93,6 +270,8 @@ namespace HSLL
         /**
          * @brief Check if server instance is available for new operations
          * @return true if available, false otherwise
+         * @details A parked session is free: Park() touches nothing once its CAS to WAKE_PARKED succeeds,
+         *          and Wake() runs on the event loop thread like the disconnection
          */
         bool CheakFree();
 
@@ -111,6 +290,37 @@ namespace HSLL
             DATA_MODE_PASSIVE //!< Passive mode data connection
         };
 
+        /// Transfer type enumeration (TYPE command)
+        enum TransferType
+        {
+            TRANSFER_TYPE_ASCII, //!< ASCII transfer, line endings converted on the buffered path
+            TRANSFER_TYPE_BINARY //!< Image (binary) transfer, eligible for zero-copy
+        };
+
+        /// Directory listing style
+        enum ListStyle
+        {
+            LIST_STYLE_LONG,  //!< ls-style long lines (LIST)
+            LIST_STYLE_NAMES, //!< Names only (NLST)
+            LIST_STYLE_FACTS, //!< Machine-readable facts (MLSD)
+            LIST_STYLE_TREE   //!< Recursive long lines (LIST -R)
+        };
+
+        /// Park handshake state
+        enum WakeState
+        {
+            WAKE_RUNNING,  //!< The transfer coroutine is running (or not parked)
+            WAKE_PARKED,   //!< Parked, the next event resumes the transfer
+            WAKE_NOTIFIED  //!< An event arrived while running, Park() must not wait
+        };
+
+        /// Transfer mode enumeration (MODE command)
+        enum TransferMode
+        {
+            TRANSFER_MODE_STREAM, //!< Stream mode, data sent as is
+            TRANSFER_MODE_DEFLATE //!< MODE Z, data channel carries a zlib stream
+        };
+
         EVBuffer evb;           //!< Underlying event buffer object
         ConnectionInfo info;    //!< Connection information structure
         std::string sWaitParse; //!< Buffer for incoming data awaiting parsing
@@ -121,26 +331,72 @@ namespace HSLL
         bool certified;  //!< Client authentication status flag
         bool enableFree; //!< Flag indicating availability for new operations
 
-        std::string user;           //!< Current authenticated username
-        std::string clientIP;       //!< Client IP address for active mode
-        std::string currentDir;     //!< Current working directory path
-        std::string renameFromPath; //!< Temporary storage for RNFR command path
+        std::string user;                      //!< Current authenticated username
+        std::string clientIP;                  //!< Client IP address for active mode
+        std::string currentDir;                //!< Current working directory path
+        std::string renameFromPath;            //!< Temporary storage for RNFR command path
+        std::shared_ptr<PrefetchJob> prefetch; //!< Listing prefetch started by the last CWD
 
         int dataSocket;              //!< Active data connection socket
         int pasvSocket;              //!< Passive mode listening socket
+        unsigned short pasvPort;     //!< Port of the passive listening socket
+        off_t restOffset;            //!< REST offset for the next RETR/STOR, 0 for none
+        off_t restEnd;               //!< RANG end (exclusive) for the next RETR/STOR, -1 for end of file
+        off_t allocSize;             //!< ALLO size for the next STOR, -1 for none
         int clientPort;              //!< Client port for active mode connections
         DataConnectionMode dataMode; //!< Current data connection mode
+        TransferType transferType;   //!< Current transfer type
+        TransferMode transferMode;   //!< Current transfer mode
+        ZStream *zstream;            //!< Compression stream of the running MODE Z transfer
+
+        char *ioBuffers[2];                             //!< Pipeline buffers borrowed from the pool
+        char *textBuffer;                               //!< TYPE A conversion buffer borrowed from the pool
+        char *stageBuffer;                              //!< Receive buffer of uploads that convert or inflate
+        size_t ioSizes[2];                              //!< Sizes of ioBuffers
+        size_t textBufferSize;                          //!< Size of textBuffer
+        size_t bufferHint;                              //!< Buffer size matching the observed throughput
+        off_t ratePosition;                             //!< File position at the last throughput sample
+        std::chrono::steady_clock::time_point rateTime; //!< Time of the last throughput sample
+
+        std::string sizedPath;                           //!< File opened by the last SIZE
+        int sizedFd;                                     //!< Descriptor of sizedPath, -1 for none
+        struct stat sizedStat;                           //!< Attributes of sizedPath at SIZE time
+        std::chrono::steady_clock::time_point sizedTime; //!< Time of the last SIZE
 
         Generator<START_FLAG::START_FLAG_NOSUSPEND> task; //!< Coroutine task handler
+        URingRequest ioRequest;                           //!< Outstanding io_uring data-channel operation
+        URingRequest diskRequest;                         //!< Outstanding file read or write of the pipeline
+        std::atomic<int> wakeState;                       //!< WakeState of the park handshake
+        EVWatcher watcher;                                //!< Readiness watch for the parked transfer
+        int waitFd;                                       //!< Descriptor the suspended transfer waits on
+        short waitEvents;                                 //!< Events the suspended transfer waits for
+        bool connecting;                                  //!< Waiting for the data connection to be established
+        bool waitExpired;                                 //!< The data connection did not arrive in time
 
         /**
-         * @brief Handle LIST/NLST command (directory listing)
+         * @brief Handle LIST/NLST/MLSD command (directory listing)
+         * @param style Listing style
+         * @param path Directory to list, relative to the current directory; empty for the current directory
          * @return Generator for coroutine management
          */
-        Generator<START_FLAG::START_FLAG_NOSUSPEND> HandleList();
+        Generator<START_FLAG::START_FLAG_NOSUSPEND> HandleList(ListStyle style, const std::string &path);
+
+        /**
+         * @brief Handle STAT with an argument (listing on the control connection)
+         * @param param ls-style options and path; -R lists recursively
+         */
+        void HandleSTAT(const std::string &param);
+
+        /**
+         * @brief Handle MLST command (facts of one file on the control connection)
+         * @param param Path of the file, empty for the current directory
+         */
+        void HandleMLST(const std::string &param);
 
         /**
          * @brief Handle file download (RETR command)
+         * @details Binary transfers are streamed with sendfile(); otherwise the next block is
+         *          read into the idle pipeline buffer while the current one is sent
          * @param param Filename parameter from client
          * @return Generator for coroutine management
          */
@@ -148,6 +404,9 @@ namespace HSLL
 
         /**
          * @brief Handle file upload (STOR command)
+         * @details Binary transfers are spliced from the data socket into the file through a
+         *          per-worker pipe; otherwise received data fills one pipeline buffer while the
+         *          other is written to the file, with O_DIRECT when ALLO announced a large file
          * @param param Filename parameter from client
          * @return Generator for coroutine management
          */
@@ -184,6 +443,47 @@ namespace HSLL
          */
         void HandlePORT(const std::string &param);
 
+        /**
+         * @brief Borrow pipeline buffers of the size suggested by the session's throughput
+         * @param position Current file position, starts the throughput sample
+         * @param stage Whether a receive buffer for converting uploads is needed too
+         * @return true on success, false if the pool is out of memory
+         */
+        bool BorrowBuffers(off_t position, bool stage);
+
+        /**
+         * @brief Sample throughput and switch a pipeline buffer's size class when it no longer fits
+         * @param index Pipeline buffer to resize
+         * @param position Current file position
+         * @note Must only be called when no I/O refers to the buffer
+         */
+        void TuneBuffer(int index, off_t position);
+
+        /**
+         * @brief Return borrowed transfer buffers to the pool
+         */
+        void ReturnBuffers();
+
+        /**
+         * @brief Look up the file kept open by the last SIZE
+         * @param path Full path of the file
+         * @param st Receives the attributes recorded by SIZE
+         * @return true if path is kept open and was sized recently, false otherwise (an expired file is closed)
+         */
+        bool FindSized(const std::string &path, struct stat &st);
+
+        /**
+         * @brief Take over the descriptor kept open by the last SIZE
+         * @param path Full path of the file
+         * @return Descriptor owned by the caller, -1 if path is not kept open
+         */
+        int TakeSized(const std::string &path);
+
+        /**
+         * @brief Close the file kept open by the last SIZE
+         */
+        void DropSized();
+
         /**
          * @brief Handle PASV command (passive mode setup)
          */
@@ -195,11 +495,20 @@ namespace HSLL
          */
         bool DealTask();
 
+        /**
+         * @brief Wait for the event a suspended task needs
+         * @details Submits the staged io_uring operation, or watches the descriptor recorded by
+         *          WaitFor() on the event loop, and waits for the pipeline's file operation as well.
+         *          Re-enables control events if there is nothing to wait for, and keeps running the
+         *          task on this thread if an event arrived before the session was parked
+         */
+        void Park();
+
         /**
          * @brief Establish data connection based on current mode
-         * @return true if connection established successfully
+         * @return 1 if established, 0 if pending (suspend and call again), -1 on failure
          */
-        bool EstablishDataConnection();
+        int EstablishDataConnection();
 
         /**
          * @brief Close active data connections
@@ -207,11 +516,18 @@ namespace HSLL
         void CloseDataConnection();
 
         /**
-         * @brief Set socket timeout parameters
+         * @brief Record the descriptor and events a transfer is about to suspend on
+         * @param fd Descriptor to watch
+         * @param events EV_READ or EV_WRITE
+         * @return Awaitable that suspends the coroutine
+         */
+        std::suspend_always WaitFor(int fd, short events);
+
+        /**
+         * @brief Switch a data socket to non-blocking mode
          * @param socket Target socket descriptor
-         * @param seconds Timeout in seconds
          */
-        void SetSocketTimeout(int socket, int seconds);
+        void SetSocketNonBlocking(int socket);
     };
 }
 #endif
\ No newline at end of file
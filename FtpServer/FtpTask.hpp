@@ -19,7 +19,8 @@
      {
          FTP_TASK_TYPE_READ,    //!< Data read operation task
          FTP_TASK_TYPE_WRITE,   //!< Data write operation task
-         FTP_TASK_TYPE_ACCEPT    //!< New connection acceptance task
+         FTP_TASK_TYPE_ACCEPT,  //!< New connection acceptance task
+         FTP_TASK_TYPE_RESUME   //!< Parked transfer resumption task
      };
  
      /**
@@ -45,6 +46,9 @@
              case FTP_TASK_TYPE_WRITE:
                  ftpServer->DealWrite();
                  break;
+             case FTP_TASK_TYPE_RESUME:
+                 ftpServer->DealResume();
+                 break;
              default:
                  ftpServer->DealAccept();
                  break;
@@ -55,6 +59,53 @@
      /// Global thread pool instance for FTP task processing
      ThreadPool<FTPTask> pool;
  
+     /**
+      * @brief Queue the resume task of a parked transfer
+      * @param ftpServer FTPServer instance the caller has woken
+      */
+     void FTPQueueResume(FTPServer *ftpServer)
+     {
+         ftpServer->DisableRW();
+ 
+         if (pool.Append(FTPTask{FTP_TASK_TYPE_RESUME, ftpServer}) == false)
+             ftpServer->EnableRW();
+     }
+ 
+     /**
+      * @brief Handle completion of a parked transfer operation
+      * @param ctx FTPServer instance pointer
+      * @details Runs on the event loop thread; queues resume task to thread pool
+      */
+     void FTPResume(void *ctx)
+     {
+         FTPServer *ftpServer = (FTPServer *)ctx;
+         if (ftpServer->Wake(0))
+             FTPQueueResume(ftpServer);
+     }
+ 
+     /**
+      * @brief Handle readiness of a parked transfer's data socket
+      * @param ctx FTPServer instance pointer
+      * @param events Triggered event flags
+      * @details Runs on the event loop thread; a timeout fails the transfer and closes the session
+      */
+     void FTPReady(void *ctx, short events)
+     {
+         FTPServer *ftpServer = (FTPServer *)ctx;
+         if (ftpServer->Wake(events))
+             FTPQueueResume(ftpServer);
+     }
+ 
+     /**
+      * @brief Convert a prefetched listing to UTF-8
+      * @param listing Listing in the system encoding
+      * @return Converted listing
+      */
+     std::string FTPEncodeListing(const std::string &listing)
+     {
+         return convertEncoding(listing, ServerInfo::encoding, "UTF-8");
+     }
+ 
      /**
       * @brief Handle new FTP connection
       * @param evb Event buffer for the connection
@@ -64,7 +115,7 @@
       */
      void *FTPConnection(EVBuffer evb, ConnectionInfo info)
      {
-         FTPServer *ftpServer = new FTPServer(evb,info);
+         FTPServer *ftpServer = new FTPServer(evb, info, FTPReady);
          ftpServer->DisableRW();
  
          if (pool.Append(FTPTask{FTP_TASK_TYPE_ACCEPT, ftpServer}) == false)
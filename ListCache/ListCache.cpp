@@ -0,0 +1,447 @@
+#include "ListCache.h"
+#include "../Listing/Listing.h"
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/**
+ * @brief Changes of a cached directory that invalidate its listing
+ */
+#define HSLL_LISTCACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | \
+                               IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+namespace HSLL
+{
+    size_t ListCache::budget = 0;
+    size_t ListCache::usage = 0;
+    int ListCache::inotifyFd = -1;
+    EVWatcher *ListCache::watcher = nullptr;
+    std::mutex ListCache::mtx;
+    std::map<std::string, ListCache::Entry> ListCache::entries;
+    std::map<int, std::string> ListCache::watches;
+    std::list<std::string> ListCache::lru;
+    unsigned long long ListCache::tokens = 0;
+    std::atomic<unsigned long long> ListCache::hits{0};
+    std::atomic<unsigned long long> ListCache::misses{0};
+    size_t ListCache::prefetchSize = 0;
+    EncodeProc ListCache::encode = nullptr;
+    std::thread ListCache::prefetcher;
+    std::deque<std::shared_ptr<PrefetchJob>> ListCache::jobs;
+    std::mutex ListCache::jobMtx;
+    std::condition_variable ListCache::jobCv;
+    bool ListCache::stopping = false;
+    std::atomic<unsigned long long> ListCache::prefetched{0};
+    std::atomic<unsigned long long> ListCache::prefetchHits{0};
+    std::atomic<unsigned long long> ListCache::prefetchWasted{0};
+
+    PrefetchJob::PrefetchJob(const std::string &dir, bool utf8) : dir(dir), utf8(utf8), cancelled(false)
+    {
+    }
+
+    bool ListCache::Init(size_t budget, size_t prefetchSize, EncodeProc encode)
+    {
+        if (budget == 0)
+            return true;
+
+        if (inotifyFd != -1)
+            return false;
+
+        if ((inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+            goto exitFalse;
+
+        watcher = new EVWatcher(Callback_Notify, nullptr);
+        if (watcher->Watch(inotifyFd, EV_READ | EV_PERSIST, 0) != 0)
+            goto exitFalse;
+
+        ListCache::budget = budget;
+        HSLL_LOGINFO(LOG_LEVEL_INFO, "Listing cache enabled, budget: ", budget, " bytes")
+
+        if (prefetchSize && encode)
+        {
+            ListCache::prefetchSize = prefetchSize;
+            ListCache::encode = encode;
+            stopping = false;
+            prefetcher = std::thread(Prefetcher);
+        }
+        return true;
+
+    exitFalse:
+        Release();
+        return false;
+    }
+
+    void ListCache::Release()
+    {
+        if (prefetcher.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(jobMtx);
+                stopping = true;
+            }
+            jobCv.notify_all();
+            prefetcher.join();
+            jobs.clear();
+            prefetchSize = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            budget = 0;
+            usage = 0;
+            entries.clear();
+            watches.clear();
+            lru.clear();
+        }
+
+        if (watcher)
+        {
+            delete watcher;
+            watcher = nullptr;
+        }
+
+        if (inotifyFd != -1)
+        {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+    }
+
+    std::string ListCache::Canonical(const std::string &dir)
+    {
+        char path[PATH_MAX];
+        if (realpath(dir.c_str(), path) == nullptr)
+            return std::string();
+        return path;
+    }
+
+    void ListCache::Erase(std::map<std::string, Entry>::iterator it)
+    {
+        if (it->second.prefetched)
+            prefetchWasted.fetch_add(1, std::memory_order_relaxed);
+
+        inotify_rm_watch(inotifyFd, it->second.wd);
+        watches.erase(it->second.wd);
+        lru.erase(it->second.used);
+        usage -= it->first.size() + sizeof(Entry) + (it->second.raw ? it->second.raw->size() : 0) +
+                 (it->second.utf8 ? it->second.utf8->size() : 0);
+        entries.erase(it);
+    }
+
+    bool ListCache::Find(const std::string &path, bool utf8, std::shared_ptr<const std::string> *listing, unsigned long long &token)
+    {
+        token = 0;
+
+        auto it = entries.find(path);
+        if (it != entries.end())
+        {
+            Entry &entry = it->second;
+            lru.splice(lru.begin(), lru, entry.used);
+
+            if (utf8 ? entry.utf8 : entry.raw)
+            {
+                if (listing)
+                {
+                    *listing = utf8 ? entry.utf8 : entry.raw;
+                    if (entry.prefetched)
+                    {
+                        entry.prefetched = false;
+                        prefetchHits.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                return true;
+            }
+
+            // The latest builder takes the placeholder over, so one that gives up cannot drop it from under the other
+            entry.token = ++tokens;
+            token = entry.token;
+            return false;
+        }
+
+        // The watch is placed before the directory is read, so no change can slip between the two
+        int wd = inotify_add_watch(inotifyFd, path.c_str(), HSLL_LISTCACHE_EVENTS);
+        if (wd < 0 || watches.count(wd))
+            return false;
+
+        lru.push_front(path);
+        Entry &entry = entries[path];
+        entry.wd = wd;
+        entry.token = ++tokens;
+        entry.prefetched = false;
+        entry.used = lru.begin();
+        watches[wd] = path;
+        usage += path.size() + sizeof(Entry);
+        Trim();
+
+        token = entry.token;
+        return false;
+    }
+
+    void ListCache::Put(const std::string &path, bool utf8, std::shared_ptr<const std::string> listing, unsigned long long token, bool prefetch)
+    {
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.token != token || (utf8 ? it->second.utf8 : it->second.raw))
+            return;
+
+        usage += listing->size();
+        (utf8 ? it->second.utf8 : it->second.raw) = std::move(listing);
+        it->second.prefetched = prefetch;
+        lru.splice(lru.begin(), lru, it->second.used);
+        Trim();
+    }
+
+    void ListCache::Drop(const std::string &path, unsigned long long token)
+    {
+        auto it = entries.find(path);
+        if (it != entries.end() && it->second.token == token && !it->second.raw && !it->second.utf8)
+            Erase(it);
+    }
+
+    void ListCache::Trim()
+    {
+        while (usage > budget && lru.size() > 1)
+            Erase(entries.find(lru.back()));
+    }
+
+    bool ListCache::Lookup(const std::string &dir, bool utf8, std::shared_ptr<const std::string> &listing, unsigned long long &token)
+    {
+        token = 0;
+        if (budget == 0)
+            return false;
+
+        std::string path = Canonical(dir);
+        if (path.empty())
+            return false;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        bool hit = Find(path, utf8, &listing, token);
+        (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+        return hit;
+    }
+
+    void ListCache::Store(const std::string &dir, bool utf8, std::string listing, unsigned long long token)
+    {
+        if (token == 0 || !Fits(listing.size()))
+            return;
+
+        std::string path = Canonical(dir);
+        if (path.empty())
+            return;
+
+        std::shared_ptr<const std::string> shared = std::make_shared<const std::string>(std::move(listing));
+        std::lock_guard<std::mutex> lock(mtx);
+        Put(path, utf8, std::move(shared), token, false);
+    }
+
+    void ListCache::Abandon(const std::string &dir, unsigned long long token)
+    {
+        if (token == 0)
+            return;
+
+        std::string path = Canonical(dir);
+        if (path.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        Drop(path, token);
+    }
+
+    bool ListCache::Fits(size_t size)
+    {
+        return size <= budget / 2;
+    }
+
+    void ListCache::Invalidate(const std::string &dir)
+    {
+        if (budget == 0)
+            return;
+
+        std::string path = Canonical(dir);
+        if (path.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(path);
+        if (it != entries.end())
+            Erase(it);
+    }
+
+    void ListCache::InvalidateParent(const std::string &path)
+    {
+        size_t last = path.find_last_not_of('/');
+        size_t index = (last == std::string::npos) ? std::string::npos : path.find_last_of('/', last);
+        Invalidate((index == std::string::npos) ? std::string(".") : (index == 0) ? std::string("/") : path.substr(0, index));
+    }
+
+    std::shared_ptr<PrefetchJob> ListCache::Prefetch(const std::string &dir, bool utf8)
+    {
+        if (prefetchSize == 0)
+            return nullptr;
+
+        std::shared_ptr<PrefetchJob> job = std::make_shared<PrefetchJob>(dir, utf8);
+        {
+            std::lock_guard<std::mutex> lock(jobMtx);
+            if (jobs.size() >= HSLL_LISTCACHE_PREFETCH_QUEUE)
+                return nullptr;
+            jobs.push_back(job);
+        }
+        jobCv.notify_one();
+        return job;
+    }
+
+    void ListCache::Cancel(std::shared_ptr<PrefetchJob> &job)
+    {
+        if (job)
+        {
+            job->cancelled.store(true, std::memory_order_relaxed);
+            job.reset();
+        }
+    }
+
+    void ListCache::Prefetcher()
+    {
+        std::unique_lock<std::mutex> lock(jobMtx);
+
+        while (true)
+        {
+            jobCv.wait(lock, []
+                       { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+
+            std::shared_ptr<PrefetchJob> job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            // A job cancelled before it started costs nothing
+            if (!job->cancelled.load(std::memory_order_relaxed))
+                Build(*job);
+
+            job.reset();
+            lock.lock();
+        }
+    }
+
+    void ListCache::Build(PrefetchJob &job)
+    {
+        std::string path = Canonical(job.dir);
+        if (path.empty())
+            return;
+
+        unsigned long long token;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (Find(path, job.utf8, nullptr, token) || token == 0)
+                return;
+        }
+
+        // A listing that is not built leaves no placeholder behind
+        auto abandon = [&path, token]
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            Drop(path, token);
+        };
+
+        DirReader reader;
+        if (!reader.Open(path))
+        {
+            abandon();
+            return;
+        }
+
+        ListFormat format;
+        std::string listing;
+        const char *name;
+        unsigned char type;
+        struct stat st;
+        size_t limit = std::min(prefetchSize, budget / 2);
+        size_t count = 0;
+
+        while (reader.Next(name, type))
+        {
+            if (reader.Stat(name, st))
+                format.AppendLong(listing, name, st);
+
+            // Abandoned when the session moves on, or when the listing outgrows the prefetch cap
+            if ((++count % 256 == 0 && job.cancelled.load(std::memory_order_relaxed)) || listing.size() > limit)
+            {
+                prefetchWasted.fetch_add(1, std::memory_order_relaxed);
+                abandon();
+                return;
+            }
+        }
+
+        if (errno != 0)
+        {
+            abandon();
+            return;
+        }
+        reader.Close();
+
+        std::shared_ptr<const std::string> converted;
+        if (job.utf8)
+            converted = std::make_shared<const std::string>(encode(listing));
+        std::shared_ptr<const std::string> shared = std::make_shared<const std::string>(std::move(listing));
+
+        std::lock_guard<std::mutex> lock(mtx);
+        Put(path, false, std::move(shared), token, true);
+        if (job.utf8)
+            Put(path, true, std::move(converted), token, true);
+        prefetched.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    unsigned long long ListCache::Hits()
+    {
+        return hits.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long ListCache::Misses()
+    {
+        return misses.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long ListCache::Prefetched()
+    {
+        return prefetched.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long ListCache::PrefetchHits()
+    {
+        return prefetchHits.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long ListCache::PrefetchWasted()
+    {
+        return prefetchWasted.load(std::memory_order_relaxed);
+    }
+
+    void ListCache::Callback_Notify(void *, short)
+    {
+        alignas(inotify_event) char buffer[8192];
+        ssize_t length;
+
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+
+            for (char *pos = buffer; pos < buffer + length;)
+            {
+                inotify_event *event = (inotify_event *)pos;
+                pos += sizeof(inotify_event) + event->len;
+
+                // Lost events leave every listing suspect
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    while (!lru.empty())
+                        Erase(entries.find(lru.back()));
+                    continue;
+                }
+
+                auto watch = watches.find(event->wd);
+                if (watch != watches.end())
+                    Erase(entries.find(watch->second));
+            }
+        }
+    }
+}
@@ -0,0 +1,245 @@
+#ifndef HSLL_LISTCACHE
+#define HSLL_LISTCACHE
+
+#include <map>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+#include "../Event/Eventcplus.h"
+
+/**
+ * @brief Maximum number of prefetches waiting for the background lane
+ */
+#define HSLL_LISTCACHE_PREFETCH_QUEUE 16
+
+namespace HSLL
+{
+    typedef std::string (*EncodeProc)(const std::string &listing); //!< Converts a listing to UTF-8
+
+    /**
+     * @brief Background listing of a directory a session has just entered
+     * @details Shared between the session and the background lane, so either side may drop it first
+     */
+    struct PrefetchJob
+    {
+        std::string dir;             //!< Directory path
+        bool utf8;                   //!< Build the UTF-8 variant as well
+        std::atomic<bool> cancelled; //!< The session no longer wants the listing
+
+        /**
+         * @brief Constructor
+         */
+        PrefetchJob(const std::string &dir, bool utf8);
+    };
+
+    /**
+     * @brief Shared cache of formatted directory listings
+     * @details Listings are keyed by the canonical directory path and hold the LIST bytes in the system
+     *          encoding plus, once a UTF-8 session asked for it, the converted variant. Every cached
+     *          directory carries an inotify watch; any change reported for it drops the entry, and the
+     *          server's own MKD/RMD/DELE/RNTO/STOR drop it right away. Entries are evicted least recently
+     *          used first once the memory budget is exceeded. Stored listings are immutable and shared with
+     *          the sessions sending them, so a hit copies nothing under the lock. A background lane can list
+     *          a directory a session has just entered, so its LIST is served from the cache
+     */
+    class ListCache
+    {
+    private:
+        /// Cached listing of one directory
+        struct Entry
+        {
+            int wd;                                  //!< inotify watch descriptor
+            unsigned long long token;                //!< Identifies this incarnation of the entry
+            bool prefetched;                         //!< Filled by a prefetch that no LIST has used yet
+            std::shared_ptr<const std::string> raw;  //!< Listing in the system encoding, empty until stored
+            std::shared_ptr<const std::string> utf8; //!< Listing converted to UTF-8, empty until stored
+            std::list<std::string>::iterator used;   //!< Position in the LRU list
+        };
+
+        static size_t budget;                                  //!< Memory budget in bytes, 0 when disabled
+        static size_t usage;                                   //!< Bytes held by cached listings
+        static int inotifyFd;                                  //!< inotify instance, -1 when disabled
+        static EVWatcher *watcher;                             //!< Watches the inotify descriptor
+        static std::mutex mtx;                                 //!< Protects entries, watches, lru and tokens
+        static std::map<std::string, Entry> entries;           //!< Listings by canonical directory path
+        static std::map<int, std::string> watches;             //!< Directory path by watch descriptor
+        static std::list<std::string> lru;                     //!< Paths, most recently used first
+        static unsigned long long tokens;                      //!< Last token handed out
+        static std::atomic<unsigned long long> hits;           //!< Listings served from the cache
+        static std::atomic<unsigned long long> misses;         //!< Listings built from the directory
+        static size_t prefetchSize;                            //!< Largest listing a prefetch builds, 0 when disabled
+        static EncodeProc encode;                              //!< UTF-8 conversion of prefetched listings
+        static std::thread prefetcher;                         //!< Background lane
+        static std::deque<std::shared_ptr<PrefetchJob>> jobs;  //!< Prefetches waiting for the lane
+        static std::mutex jobMtx;                              //!< Protects jobs and stopping
+        static std::condition_variable jobCv;                  //!< Signals queued prefetches
+        static bool stopping;                                  //!< The lane is asked to exit
+        static std::atomic<unsigned long long> prefetched;     //!< Listings built by prefetches
+        static std::atomic<unsigned long long> prefetchHits;   //!< Prefetched listings a LIST used
+        static std::atomic<unsigned long long> prefetchWasted; //!< Prefetches abandoned or dropped unused
+
+        /**
+         * @brief Canonical path of a directory, empty if it cannot be resolved
+         */
+        static std::string Canonical(const std::string &dir);
+
+        /**
+         * @brief Drop an entry and its watch, mtx must be held
+         */
+        static void Erase(std::map<std::string, Entry>::iterator it);
+
+        /**
+         * @brief Look up a canonical path, watching it on a miss; mtx must be held
+         * @return true on a hit, with listing filled; otherwise token is set (0 if it cannot be cached)
+         * @details A miss on a placeholder hands out a new token, which turns the Put or Drop of an earlier
+         *          builder of the same entry into a no-op
+         */
+        static bool Find(const std::string &path, bool utf8, std::shared_ptr<const std::string> *listing, unsigned long long &token);
+
+        /**
+         * @brief Cache a listing under a canonical path, mtx must be held
+         */
+        static void Put(const std::string &path, bool utf8, std::shared_ptr<const std::string> listing, unsigned long long token, bool prefetch);
+
+        /**
+         * @brief Drop the placeholder of a listing that will not be stored, mtx must be held
+         */
+        static void Drop(const std::string &path, unsigned long long token);
+
+        /**
+         * @brief Evict least recently used entries until usage is within the budget, mtx must be held
+         * @details The most recently used entry is kept, it is the one just added
+         */
+        static void Trim();
+
+        /**
+         * @brief Background lane body
+         */
+        static void Prefetcher();
+
+        /**
+         * @brief List a directory for a prefetch
+         */
+        static void Build(PrefetchJob &job);
+
+        /**
+         * @brief Event loop callback for the inotify descriptor
+         * @param ctx Unused
+         * @param events Triggered event flags
+         */
+        static void Callback_Notify(void *ctx, short events);
+
+    public:
+        /**
+         * @brief Enable the cache
+         * @param budget Memory budget in bytes, 0 keeps the cache disabled
+         * @param prefetchSize Largest listing built by a prefetch, 0 disables prefetching
+         * @param encode UTF-8 conversion of prefetched listings
+         * @return true on success (or when disabled), false if inotify is unavailable
+         * @note EVSocket must be constructed first
+         */
+        static bool Init(size_t budget, size_t prefetchSize, EncodeProc encode);
+
+        /**
+         * @brief Disable the cache and drop every entry
+         */
+        static void Release();
+
+        /**
+         * @brief Look up a listing
+         * @param dir Directory path, canonicalized internally
+         * @param utf8 Whether the UTF-8 variant is wanted
+         * @param listing Receives the cached listing on a hit, shared with the cache and other sessions
+         * @param token Receives the token to pass to Store on a miss, 0 if the result cannot be cached
+         * @return true on a hit
+         * @details A miss starts watching the directory, so changes made while the listing is built are seen
+         */
+        static bool Lookup(const std::string &dir, bool utf8, std::shared_ptr<const std::string> &listing, unsigned long long &token);
+
+        /**
+         * @brief Cache a freshly built listing
+         * @param dir Directory path passed to Lookup
+         * @param utf8 Whether the listing is the UTF-8 variant
+         * @param listing Formatted listing
+         * @param token Token returned by Lookup, the listing is discarded if the directory was invalidated since
+         */
+        static void Store(const std::string &dir, bool utf8, std::string listing, unsigned long long token);
+
+        /**
+         * @brief Give up caching a listing after a miss
+         * @param dir Directory path passed to Lookup
+         * @param token Token returned by Lookup, 0 is ignored
+         * @details Called instead of Store when the listing turns out too large or is not completed, so the
+         *          watch and entry placed by the miss do not linger
+         */
+        static void Abandon(const std::string &dir, unsigned long long token);
+
+        /**
+         * @brief Check whether a listing of the given size can be cached
+         * @param size Listing size in bytes
+         */
+        static bool Fits(size_t size);
+
+        /**
+         * @brief Drop the listing of a directory
+         * @param dir Directory path
+         */
+        static void Invalidate(const std::string &dir);
+
+        /**
+         * @brief Drop the listing of the directory containing a path
+         * @param path File or directory path
+         */
+        static void InvalidateParent(const std::string &path);
+
+        /**
+         * @brief Start listing a directory on the background lane
+         * @param dir Directory path
+         * @param utf8 Build the UTF-8 variant as well
+         * @return The job, or nullptr if prefetching is disabled or the lane is saturated
+         * @details The listing lands in the cache, bounded by the cache budget and the prefetch size
+         */
+        static std::shared_ptr<PrefetchJob> Prefetch(const std::string &dir, bool utf8);
+
+        /**
+         * @brief Cancel a prefetch and release it
+         * @param job Job returned by Prefetch, reset on return; may be empty
+         * @details A queued job is skipped and a running one stops at its next check, abandoning its
+         *          placeholder; a listing that already landed stays in the cache
+         */
+        static void Cancel(std::shared_ptr<PrefetchJob> &job);
+
+        /**
+         * @brief Number of listings served from the cache
+         */
+        static unsigned long long Hits();
+
+        /**
+         * @brief Number of listings built from the directory
+         */
+        static unsigned long long Misses();
+
+        /**
+         * @brief Number of listings built by prefetches
+         */
+        static unsigned long long Prefetched();
+
+        /**
+         * @brief Number of prefetched listings a LIST used
+         */
+        static unsigned long long PrefetchHits();
+
+        /**
+         * @brief Number of prefetches abandoned while running or dropped before any LIST used them
+         */
+        static unsigned long long PrefetchWasted();
+    };
+}
+
+#endif
@@ -0,0 +1,450 @@
+#include "Listing.h"
+#include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <atomic>
+#include <limits>
+#include <charconv>
+#include <algorithm>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+namespace HSLL
+{
+    /// Record layout returned by getdents64
+    struct Dirent64
+    {
+        ino64_t d_ino;           //!< Inode number
+        off64_t d_off;           //!< Offset of the next record
+        unsigned short d_reclen; //!< Length of this record
+        unsigned char d_type;    //!< File type
+        char d_name[];           //!< Null-terminated name
+    };
+
+    DirReader::DirReader() : fd(-1), position(0), length(0)
+    {
+    }
+
+    DirReader::~DirReader()
+    {
+        Close();
+    }
+
+    bool DirReader::Open(const std::string &path)
+    {
+        Close();
+
+        if ((fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            return false;
+
+        if (!buffer)
+            buffer.reset(new char[HSLL_LISTING_DENTS_SIZE]);
+        position = length = 0;
+        return true;
+    }
+
+    void DirReader::Close()
+    {
+        if (fd != -1)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    bool DirReader::Next(const char *&name, unsigned char &type)
+    {
+        while (true)
+        {
+            if (position >= length)
+            {
+                long result = syscall(SYS_getdents64, fd, buffer.get(), HSLL_LISTING_DENTS_SIZE);
+                if (result <= 0)
+                {
+                    if (result == 0)
+                        errno = 0;
+                    return false;
+                }
+
+                position = 0;
+                length = (size_t)result;
+            }
+
+            Dirent64 *entry = (Dirent64 *)(buffer.get() + position);
+            position += entry->d_reclen;
+
+            if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+                continue;
+
+            name = entry->d_name;
+            type = entry->d_type;
+            return true;
+        }
+    }
+
+    bool DirReader::Stat(const char *name, struct stat &st, bool follow)
+    {
+        static std::atomic<bool> noStatx{false};
+
+        if (!noStatx.load(std::memory_order_relaxed))
+        {
+            struct statx stx;
+            if (statx(fd, name, AT_STATX_DONT_SYNC | (follow ? 0 : AT_SYMLINK_NOFOLLOW), STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) == 0)
+            {
+                st.st_mode = stx.stx_mode;
+                st.st_size = (off_t)stx.stx_size;
+                st.st_mtime = (time_t)stx.stx_mtime.tv_sec;
+                st.st_ino = (ino_t)stx.stx_ino;
+                st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+                return true;
+            }
+
+            if (errno != ENOSYS)
+                return false;
+            noStatx.store(true, std::memory_order_relaxed);
+        }
+
+        return fstatat(fd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0;
+    }
+
+    ListFormat::ListFormat() : minute(std::numeric_limits<time_t>::min())
+    {
+    }
+
+    void ListFormat::AppendLong(std::string &out, const char *name, const struct stat &st)
+    {
+        char line[64];
+        char *pos = line;
+
+        *pos++ = S_ISDIR(st.st_mode) ? 'd' : '-';
+        *pos++ = (st.st_mode & S_IRUSR) ? 'r' : '-';
+        *pos++ = (st.st_mode & S_IWUSR) ? 'w' : '-';
+        *pos++ = (st.st_mode & S_IXUSR) ? 'x' : '-';
+        *pos++ = (st.st_mode & S_IRGRP) ? 'r' : '-';
+        *pos++ = (st.st_mode & S_IWGRP) ? 'w' : '-';
+        *pos++ = (st.st_mode & S_IXGRP) ? 'x' : '-';
+        *pos++ = (st.st_mode & S_IROTH) ? 'r' : '-';
+        *pos++ = (st.st_mode & S_IWOTH) ? 'w' : '-';
+        *pos++ = (st.st_mode & S_IXOTH) ? 'x' : '-';
+        memcpy(pos, " 1 owner group ", 15);
+        pos += 15;
+
+        // Sizes are right-aligned to eight columns like "%8lld"
+        char digits[24];
+        char *end = std::to_chars(digits, digits + sizeof(digits), (long long)st.st_size).ptr;
+        for (long pad = 8 - (end - digits); pad > 0; --pad)
+            *pos++ = ' ';
+        memcpy(pos, digits, end - digits);
+        pos += end - digits;
+        *pos++ = ' ';
+
+        // Files of one directory tend to share modification minutes, so the conversion is reused
+        if (st.st_mtime / 60 != minute)
+        {
+            struct tm tm;
+            char text[16];
+            minute = st.st_mtime / 60;
+            localtime_r(&st.st_mtime, &tm);
+            if (strftime(text, sizeof(text), "%b %d %H:%M", &tm) != sizeof(stamp))
+                memset(text, '?', sizeof(stamp));
+            memcpy(stamp, text, sizeof(stamp));
+        }
+        memcpy(pos, stamp, sizeof(stamp));
+        pos += sizeof(stamp);
+        *pos++ = ' ';
+
+        out.append(line, pos - line).append(name).append("\r\n", 2);
+    }
+
+    void ListFormat::AppendFacts(std::string &out, const char *name, const struct stat &st, const char *type)
+    {
+        char line[160];
+        char *pos = line;
+        bool dir = S_ISDIR(st.st_mode);
+
+        if (type == nullptr)
+            type = dir ? "dir" : "file";
+        pos += snprintf(pos, 32, "type=%s;", type);
+
+        if (!dir)
+        {
+            memcpy(pos, "size=", 5);
+            pos = std::to_chars(pos + 5, line + sizeof(line), (long long)st.st_size).ptr;
+            *pos++ = ';';
+        }
+
+        struct tm tm;
+        gmtime_r(&st.st_mtime, &tm);
+        pos += strftime(pos, 32, "modify=%Y%m%d%H%M%S;", &tm);
+
+        memcpy(pos, "perm=", 5);
+        pos += 5;
+        if (dir)
+        {
+            if ((st.st_mode & (S_IRUSR | S_IXUSR)) == (S_IRUSR | S_IXUSR))
+                pos = (char *)memcpy(pos, "el", 2) + 2;
+            if (st.st_mode & S_IWUSR)
+                pos = (char *)memcpy(pos, "cdfmp", 5) + 5;
+        }
+        else
+        {
+            if (st.st_mode & S_IRUSR)
+                *pos++ = 'r';
+            if (st.st_mode & S_IWUSR)
+                pos = (char *)memcpy(pos, "adfw", 4) + 4;
+        }
+        *pos++ = ';';
+
+        pos += snprintf(pos, 48, "unique=%llxU%llx; ", (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+        out.append(line, pos - line).append(name).append("\r\n", 2);
+    }
+
+    void ListFormat::AppendName(std::string &out, const char *name)
+    {
+        out.append(name).append("\r\n", 2);
+    }
+
+    std::vector<std::thread> TreeWalker::threads;
+    std::deque<std::shared_ptr<TreeNode>> TreeWalker::queue;
+    std::mutex TreeWalker::mtx;
+    std::condition_variable TreeWalker::queueCv;
+    bool TreeWalker::stopping = false;
+
+    TreeNode::TreeNode(const std::string &shown, const std::string &path, int depth, size_t cap)
+        : shown(shown), path(path), depth(depth), cap(cap), queued(false), state(TREE_NODE_IDLE), failed(false), count(0)
+    {
+    }
+
+    bool TreeWalker::Init(unsigned int count)
+    {
+        if (!threads.empty() || count == 0)
+            return false;
+
+        stopping = false;
+        for (unsigned int i = 0; i < count; ++i)
+            threads.emplace_back(Serve);
+        return true;
+    }
+
+    void TreeWalker::Release()
+    {
+        if (threads.empty())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        queueCv.notify_all();
+
+        for (auto &thread : threads)
+            thread.join();
+        threads.clear();
+        queue.clear();
+    }
+
+    void TreeWalker::Serve()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        while (true)
+        {
+            queueCv.wait(lock, []
+                         { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+
+            std::shared_ptr<TreeNode> node = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            int idle = TREE_NODE_IDLE;
+            if (node->state.compare_exchange_strong(idle, TREE_NODE_READING))
+                Read(*node);
+
+            node.reset();
+            lock.lock();
+        }
+    }
+
+    void TreeWalker::Read(TreeNode &node)
+    {
+        DirReader reader;
+
+        if (reader.Open(node.path))
+        {
+            std::vector<std::pair<std::string, unsigned char>> names;
+            const char *name;
+            unsigned char type;
+            // One entry past the cap lets the walk tell a cut directory from one that just fills the limit
+            while (names.size() <= node.cap && reader.Next(name, type))
+                names.emplace_back(name, type);
+            std::sort(names.begin(), names.end());
+
+            ListFormat format;
+            struct stat st;
+            for (auto &entry : names)
+            {
+                if (!reader.Stat(entry.first.c_str(), st))
+                    continue;
+
+                format.AppendLong(node.text, entry.first.c_str(), st);
+                ++node.count;
+
+                // Links to directories are listed but not descended into, so a walk cannot loop
+                if (S_ISDIR(st.st_mode) && (entry.second == DT_DIR ||
+                                            (entry.second == DT_UNKNOWN && reader.Stat(entry.first.c_str(), st, false) && S_ISDIR(st.st_mode))))
+                    node.children.push_back(entry.first);
+            }
+        }
+        else
+        {
+            node.failed = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(node.mtx);
+            node.state.store(TREE_NODE_READY, std::memory_order_release);
+        }
+        node.readyCv.notify_all();
+    }
+
+    void TreeWalker::Acquire(TreeNode &node)
+    {
+        int idle = TREE_NODE_IDLE;
+        if (node.state.compare_exchange_strong(idle, TREE_NODE_READING))
+        {
+            Read(node);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(node.mtx);
+        node.readyCv.wait(lock, [&node]
+                          { return node.state.load(std::memory_order_acquire) == TREE_NODE_READY; });
+    }
+
+    void TreeWalker::Schedule()
+    {
+        if (threads.empty())
+            return;
+
+        size_t window = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto &node : pending)
+            {
+                if (window++ == HSLL_LISTING_TREE_WINDOW)
+                    break;
+
+                if (!node->queued)
+                {
+                    node->queued = true;
+                    queue.push_back(node);
+                }
+            }
+        }
+        queueCv.notify_all();
+    }
+
+    TreeWalker::TreeWalker() : offset(0), maxDepth(0), limit(0), entries(0), truncated(false)
+    {
+    }
+
+    TreeWalker::~TreeWalker()
+    {
+        // Queued directories are marked ready, so the readers skip them
+        for (auto &node : pending)
+        {
+            int idle = TREE_NODE_IDLE;
+            node->state.compare_exchange_strong(idle, TREE_NODE_READY);
+        }
+    }
+
+    bool TreeWalker::Start(const std::string &path, const std::string &shown, int maxDepth, size_t limit)
+    {
+        this->maxDepth = maxDepth;
+        this->limit = limit;
+        offset = entries = 0;
+        truncated = false;
+        current.reset();
+        pending.clear();
+
+        std::shared_ptr<TreeNode> root = std::make_shared<TreeNode>(shown, path, 0, limit);
+        Acquire(*root);
+        if (root->failed)
+            return false;
+
+        pending.push_back(std::move(root));
+        return true;
+    }
+
+    bool TreeWalker::Next(std::string &out, size_t size)
+    {
+        while (out.size() < size)
+        {
+            if (!current)
+            {
+                if (pending.empty())
+                    return false;
+
+                current = std::move(pending.front());
+                pending.pop_front();
+                Acquire(*current);
+
+                // Subdirectories come next, ahead of the directories already pending
+                if (current->depth < maxDepth)
+                {
+                    for (auto it = current->children.rbegin(); it != current->children.rend(); ++it)
+                        pending.push_front(std::make_shared<TreeNode>(current->shown + "/" + *it, current->path + "/" + *it,
+                                                                      current->depth + 1, limit - entries));
+                }
+                Schedule();
+
+                out.append(current->shown).append(":\r\n");
+                offset = 0;
+            }
+
+            size_t position = offset;
+            while (position < current->text.size() && out.size() + (position - offset) < size)
+            {
+                if (entries == limit)
+                {
+                    truncated = true;
+                    break;
+                }
+
+                position = current->text.find('\n', position) + 1;
+                ++entries;
+            }
+            out.append(current->text, offset, position - offset);
+            offset = position;
+
+            if (truncated)
+            {
+                out.append("\r\n");
+                current.reset();
+                return false;
+            }
+
+            if (offset == current->text.size())
+            {
+                out.append("\r\n");
+                current.reset();
+            }
+        }
+
+        return true;
+    }
+
+    size_t TreeWalker::Entries() const
+    {
+        return entries;
+    }
+
+    bool TreeWalker::Truncated() const
+    {
+        return truncated;
+    }
+}
@@ -0,0 +1,262 @@
+#ifndef HSLL_LISTING
+#define HSLL_LISTING
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <condition_variable>
+
+/**
+ * @brief Size of one getdents64 read
+ */
+#define HSLL_LISTING_DENTS_SIZE (256 * 1024)
+
+/**
+ * @brief Directories a recursive listing reads ahead of the one being sent
+ */
+#define HSLL_LISTING_TREE_WINDOW 8
+
+namespace HSLL
+{
+    /**
+     * @brief Directory enumerator over an open directory descriptor
+     * @details Entries are read with large getdents64 calls and handed out in place, without a copy or
+     *          an allocation per entry. Metadata is fetched relative to the directory descriptor, so the
+     *          kernel resolves only the last path component
+     */
+    class DirReader
+    {
+    private:
+        int fd;                         //!< Directory descriptor, -1 when closed
+        std::unique_ptr<char[]> buffer; //!< getdents64 buffer
+        size_t position;                //!< Next record in the buffer
+        size_t length;                  //!< Bytes of records in the buffer
+
+    public:
+        /**
+         * @brief Constructor
+         */
+        DirReader();
+
+        /**
+         * @brief Destructor, closes the directory
+         */
+        ~DirReader();
+
+        DirReader(const DirReader &) = delete;
+        DirReader &operator=(const DirReader &) = delete;
+
+        /**
+         * @brief Open a directory
+         * @param path Directory path
+         * @return true on success, false with errno set on failure
+         */
+        bool Open(const std::string &path);
+
+        /**
+         * @brief Close the directory
+         */
+        void Close();
+
+        /**
+         * @brief Fetch the next entry, skipping "." and ".."
+         * @param name Receives the entry name, valid until the next call
+         * @param type Receives the dirent type (DT_UNKNOWN if the file system does not report it)
+         * @return true if an entry was returned, false at the end of the directory or on error (errno set)
+         */
+        bool Next(const char *&name, unsigned char &type);
+
+        /**
+         * @brief Fetch the metadata needed by listings for an entry
+         * @param name Entry name returned by Next
+         * @param st Receives type, mode, size, modification time, device and inode number
+         * @param follow Follow a symbolic link like stat() does, otherwise describe the link itself
+         * @return true on success, false with errno set on failure
+         * @details Only the fields listings use are requested
+         */
+        bool Stat(const char *name, struct stat &st, bool follow = true);
+    };
+
+    /**
+     * @brief Formatting of listing lines into a growing buffer
+     */
+    class ListFormat
+    {
+    private:
+        time_t minute;  //!< Minute of the cached timestamp text
+        char stamp[12]; //!< "Mmm dd HH:MM" text of that minute
+
+    public:
+        /**
+         * @brief Constructor
+         */
+        ListFormat();
+
+        /**
+         * @brief Append an ls-style long line ("perm 1 owner group size date name")
+         * @param out Output buffer
+         * @param name Entry name
+         * @param st Entry metadata
+         */
+        void AppendLong(std::string &out, const char *name, const struct stat &st);
+
+        /**
+         * @brief Append an MLSD/MLST fact line ("type=...;size=...;modify=...;perm=...;unique=...; name")
+         * @param out Output buffer
+         * @param name Entry name
+         * @param st Entry metadata
+         * @param type Type fact overriding the one derived from the mode (such as "cdir"), nullptr for none
+         * @details perm is derived from the owner permission bits: r for readable files, adfw for writable
+         *          ones, el for searchable directories and cdfmp for writable ones
+         */
+        static void AppendFacts(std::string &out, const char *name, const struct stat &st, const char *type = nullptr);
+
+        /**
+         * @brief Append a names-only line
+         * @param out Output buffer
+         * @param name Entry name
+         */
+        static void AppendName(std::string &out, const char *name);
+    };
+
+    /// Progress of a directory of a recursive listing
+    enum TREE_NODE_STATE
+    {
+        TREE_NODE_IDLE,    //!< Not read yet
+        TREE_NODE_READING, //!< Claimed by a reader thread or the session
+        TREE_NODE_READY    //!< Read (or abandoned)
+    };
+
+    /**
+     * @brief Directory of a recursive listing
+     * @details Shared between the walk and the reader thread that may be reading it, so a walk can be
+     *          abandoned while a read is in progress
+     */
+    struct TreeNode
+    {
+        std::string shown;                 //!< Path printed in the listing header
+        std::string path;                  //!< Path on disk
+        int depth;                         //!< Depth below the root of the walk
+        size_t cap;                        //!< Maximum number of entries read
+        bool queued;                       //!< Handed to the reader threads
+        std::atomic<int> state;            //!< TREE_NODE_STATE of the node
+        std::mutex mtx;                    //!< Protects the wait for state READY
+        std::condition_variable readyCv;   //!< Signals state READY
+        bool failed;                       //!< The directory could not be opened
+        size_t count;                      //!< Lines in text
+        std::string text;                  //!< Long lines of the entries, sorted by name
+        std::vector<std::string> children; //!< Names of the subdirectories, sorted
+
+        /**
+         * @brief Constructor
+         */
+        TreeNode(const std::string &shown, const std::string &path, int depth, size_t cap);
+    };
+
+    /**
+     * @brief Recursive (ls -R style) directory listing
+     * @details Directories are listed depth-first with entries sorted by name, so the output does not
+     *          depend on timing. Shared reader threads read a window of directories ahead of the one being
+     *          emitted; the session reads a directory itself when no reader has claimed it yet, so a walk
+     *          never waits for a queued read. The walk stops at a depth and an entry count limit
+     */
+    class TreeWalker
+    {
+    private:
+        static std::vector<std::thread> threads;              //!< Reader threads
+        static std::deque<std::shared_ptr<TreeNode>> queue;   //!< Directories waiting for a reader
+        static std::mutex mtx;                                //!< Protects queue and stopping
+        static std::condition_variable queueCv;               //!< Signals queued directories
+        static bool stopping;                                 //!< The readers are asked to exit
+
+        std::deque<std::shared_ptr<TreeNode>> pending; //!< Directories still to emit, in output order
+        std::shared_ptr<TreeNode> current;             //!< Directory being emitted
+        size_t offset;                                 //!< Emitted bytes of current's text
+        int maxDepth;                                  //!< Deepest level listed
+        size_t limit;                                  //!< Maximum number of entries listed
+        size_t entries;                                //!< Entries emitted so far
+        bool truncated;                                //!< A limit cut the listing short
+
+        /**
+         * @brief Reader thread body
+         */
+        static void Serve();
+
+        /**
+         * @brief Read a directory claimed by the caller
+         */
+        static void Read(TreeNode &node);
+
+        /**
+         * @brief Read a directory unless a reader claimed it, then wait until it is ready
+         */
+        static void Acquire(TreeNode &node);
+
+        /**
+         * @brief Hand the directories of the read-ahead window to the reader threads
+         */
+        void Schedule();
+
+    public:
+        /**
+         * @brief Start the reader threads
+         * @param count Number of reader threads
+         * @return true on success
+         */
+        static bool Init(unsigned int count);
+
+        /**
+         * @brief Stop the reader threads
+         */
+        static void Release();
+
+        /**
+         * @brief Constructor
+         */
+        TreeWalker();
+
+        /**
+         * @brief Destructor, abandons the directories not read yet
+         */
+        ~TreeWalker();
+
+        TreeWalker(const TreeWalker &) = delete;
+        TreeWalker &operator=(const TreeWalker &) = delete;
+
+        /**
+         * @brief Start a walk
+         * @param path Root directory on disk
+         * @param shown Root path printed in the listing
+         * @param maxDepth Deepest level listed, 0 for the root only
+         * @param limit Maximum number of entries listed
+         * @return true on success, false if the root cannot be read
+         */
+        bool Start(const std::string &path, const std::string &shown, int maxDepth, size_t limit);
+
+        /**
+         * @brief Append the next part of the listing
+         * @param out Output buffer, receives whole lines
+         * @param size Stop appending once out holds this many bytes
+         * @return true if more output follows, false once the walk is complete
+         */
+        bool Next(std::string &out, size_t size);
+
+        /**
+         * @brief Number of entries emitted so far
+         */
+        size_t Entries() const;
+
+        /**
+         * @brief Check whether a limit cut the listing short
+         */
+        bool Truncated() const;
+    };
+}
+
+#endif
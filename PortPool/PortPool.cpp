@@ -0,0 +1,119 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "PortPool.h"
+
+namespace HSLL
+{
+    unsigned short PortPool::low = 0;
+    std::vector<int> PortPool::fds;
+    std::vector<int> PortPool::idle;
+    std::minstd_rand PortPool::rng{std::random_device{}()};
+    std::mutex PortPool::mtx;
+
+    void PortPool::Drain(int fd)
+    {
+        // Listeners are blocking when io_uring accepts on them, and a queued connection may vanish before accept()
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+            return;
+
+        int stale;
+        while ((stale = accept(fd, nullptr, nullptr)) != -1)
+            close(stale);
+
+        if (!(flags & O_NONBLOCK))
+            fcntl(fd, F_SETFL, flags);
+    }
+
+    bool PortPool::Init(unsigned short low, unsigned short high, bool nonblock)
+    {
+        if (low == 0 || high < low)
+            return false;
+
+        PortPool::low = low;
+        fds.assign(high - low + 1, -1);
+        idle.clear();
+        idle.reserve(fds.size());
+
+        for (size_t i = 0; i < fds.size(); ++i)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0), 0);
+            if (fd < 0)
+                goto exitFalse;
+
+            fds[i] = fd;
+
+            int opt = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(low + i);
+
+            if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+                goto exitFalse;
+
+            idle.push_back(fds.size() - 1 - i);
+        }
+
+        return true;
+
+    exitFalse:
+        Release();
+        return false;
+    }
+
+    void PortPool::Release()
+    {
+        for (int fd : fds)
+        {
+            if (fd != -1)
+                close(fd);
+        }
+
+        fds.clear();
+        idle.clear();
+        low = 0;
+    }
+
+    bool PortPool::Enabled()
+    {
+        return !fds.empty();
+    }
+
+    int PortPool::Acquire(unsigned short &port)
+    {
+        int index;
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (idle.empty())
+                return -1;
+
+            size_t pick = std::uniform_int_distribution<size_t>(0, idle.size() - 1)(rng);
+            index = idle[pick];
+            idle[pick] = idle.back();
+            idle.pop_back();
+        }
+
+        Drain(fds[index]);
+        port = low + index;
+        return fds[index];
+    }
+
+    void PortPool::Release(int fd, unsigned short port)
+    {
+        size_t index = port - low;
+        if (port < low || index >= fds.size() || fds[index] != fd)
+        {
+            close(fd);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        idle.push_back(index);
+    }
+}
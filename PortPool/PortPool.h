@@ -0,0 +1,71 @@
+#ifndef HSLL_PORTPOOL
+#define HSLL_PORTPOOL
+
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace HSLL
+{
+    /**
+     * @brief Pre-bound passive mode listeners
+     * @details One listening socket is bound for every port of the configured range at startup.
+     *          Sessions borrow a listener for a PASV command and hand it back when the data connection
+     *          is established or abandoned, so passive transfers cost no socket setup and only use
+     *          ports that can be opened in a firewall. Allocation and release are O(1) on a free list;
+     *          the next port is drawn from it at random, so it cannot be predicted from the last PASV reply
+     */
+    class PortPool
+    {
+    private:
+        static unsigned short low;    //!< First port of the range
+        static std::vector<int> fds;  //!< Listener of each port, indexed by port - low
+        static std::vector<int> idle; //!< Free list of indexes into fds
+        static std::minstd_rand rng;  //!< Picks the next free port
+        static std::mutex mtx;        //!< Protects the free list and rng
+
+        /**
+         * @brief Close connections queued on a listener that no session is waiting for
+         * @param fd Listening socket
+         */
+        static void Drain(int fd);
+
+    public:
+        /**
+         * @brief Bind and listen on every port of a range
+         * @param low First port of the range
+         * @param high Last port of the range
+         * @param nonblock Whether the listeners are non-blocking (false when accepts go through io_uring)
+         * @return true on success, false if any port could not be bound (no listener is kept)
+         */
+        static bool Init(unsigned short low, unsigned short high, bool nonblock);
+
+        /**
+         * @brief Close all listeners
+         */
+        static void Release();
+
+        /**
+         * @brief Check whether passive ports come from the pool
+         * @return true if a range is configured
+         */
+        static bool Enabled();
+
+        /**
+         * @brief Borrow a free listener
+         * @param port Receives the listening port
+         * @return Listening socket, or -1 if every port is in use
+         */
+        static int Acquire(unsigned short &port);
+
+        /**
+         * @brief Return a listener to the pool
+         * @param fd Listening socket
+         * @param port Port it listens on
+         * @note Sockets that do not belong to the pool are closed instead
+         */
+        static void Release(int fd, unsigned short port);
+    };
+}
+
+#endif
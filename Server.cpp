@@ -37,6 +37,30 @@ int main(int argc, char *argv[])
         return -1;
 
     pool.Init(10000, 6);
+    ZStream::Init(ServerInfo::deflateLevel);
+    BufferPool::Init(ServerInfo::hugepages);
+    CachePolicy::Init(ServerInfo::cacheDropSize);
+
+    if (ServerInfo::uring && URing::Init(4096, ServerInfo::rwtimeout, FTPResume) == false)
+        HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "io_uring is unavailable, using synchronous data transfers")
+
+    if (!URing::Enabled() && URing::InitThreads(4, FTPResume) == false)
+        HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "File I/O helper threads are unavailable, using synchronous file access")
+
+    if (TreeWalker::Init(4) == false)
+        HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Directory reader threads are unavailable, recursive listings read one directory at a time")
+
+    if (ListCache::Init(ServerInfo::listCacheSize, ServerInfo::prefetchSize, FTPEncodeListing) == false)
+        HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "inotify is unavailable, directory listings are not cached")
+
+    if (GroupCommit::Init(ServerInfo::durability, ServerInfo::commitWindow, FTPResume) == false)
+        HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Group commit is unavailable, uploads complete without flushing")
+
+    if (ServerInfo::pasvLow && PortPool::Init(ServerInfo::pasvLow, ServerInfo::pasvHigh, !URing::Enabled()) == false)
+    {
+        HSLL_LOGINFO(LOG_LEVEL_ERROR, "Unable to bind the passive port range")
+        return -1;
+    }
 
     HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "The server is ready to start")
 
@@ -44,8 +68,18 @@ int main(int argc, char *argv[])
         return -1;
 
     pool.Exit();
+    GroupCommit::Release();
+    ListCache::Release();
+    TreeWalker::Release();
+    URing::Release();
+    PortPool::Release();
+    ZStream::Release();
+    BufferPool::Release();
     socket->Release();
 
+    HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Page cache prefetched: ", CachePolicy::Prefetched(), " bytes, dropped: ", CachePolicy::Dropped(), " bytes")
+    HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Listing cache hits: ", ListCache::Hits(), ", misses: ", ListCache::Misses())
+    HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Listing prefetches: ", ListCache::Prefetched(), ", used: ", ListCache::PrefetchHits(), ", wasted: ", ListCache::PrefetchWasted())
     HSLL_LOGINFO(LOG_LEVEL_CRUCIAL, "Exit success")
     return 0;
 }
\ No newline at end of file
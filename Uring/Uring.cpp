@@ -0,0 +1,555 @@
+#include "Uring.h"
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+namespace HSLL
+{
+    int URing::ringFd = -1;
+    int URing::eventFd = -1;
+    unsigned int URing::seconds = 0;
+    unsigned int URing::sqEntries = 0;
+    unsigned int URing::sqLocalTail = 0;
+    unsigned int *URing::sqHead = nullptr;
+    unsigned int *URing::sqTail = nullptr;
+    unsigned int *URing::sqMask = nullptr;
+    unsigned int *URing::sqFlags = nullptr;
+    unsigned int *URing::sqArray = nullptr;
+    unsigned int *URing::cqHead = nullptr;
+    unsigned int *URing::cqTail = nullptr;
+    unsigned int *URing::cqMask = nullptr;
+    io_uring_sqe *URing::sqes = nullptr;
+    io_uring_cqe *URing::cqes = nullptr;
+    void *URing::sqRing = MAP_FAILED;
+    void *URing::cqRing = MAP_FAILED;
+    size_t URing::sqRingSize = 0;
+    size_t URing::cqRingSize = 0;
+    size_t URing::sqesSize = 0;
+    bool URing::sqPoll = false;
+    std::mutex URing::mtx;
+    CompleteProc URing::cp = nullptr;
+    EVWatcher *URing::watcher = nullptr;
+    std::vector<std::thread> URing::threads;
+    std::deque<URingRequest *> URing::backlog;
+    std::deque<URingRequest *> URing::queued;
+    std::vector<URingRequest *> URing::served;
+    std::mutex URing::threadMtx;
+    std::condition_variable URing::queueCv;
+    std::condition_variable URing::serveCv;
+    bool URing::stopping = false;
+
+    static int io_uring_setup(unsigned int entries, io_uring_params *params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    static int io_uring_enter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    static int io_uring_register(int fd, unsigned int opcode, const void *arg, unsigned int args)
+    {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, args);
+    }
+
+    URingRequest::URingRequest(void *ctx) : ctx(ctx), state(URING_STATE_IDLE), result(0),
+                                            opcode(0), fd(-1), addr(0), len(0), offset(0),
+                                            peer{}, timeout{}
+    {
+    }
+
+    bool URing::Init(unsigned int entries, unsigned int seconds, CompleteProc cp)
+    {
+        if (ringFd != -1 || cp == nullptr)
+            return false;
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 100;
+
+        if ((ringFd = io_uring_setup(entries, &params)) < 0)
+        {
+            memset(&params, 0, sizeof(params));
+            if ((ringFd = io_uring_setup(entries, &params)) < 0)
+            {
+                ringFd = -1;
+                return false;
+            }
+        }
+
+        sqPoll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+        URing::seconds = seconds;
+        URing::cp = cp;
+
+        // FAST_POLL (5.7) implies every opcode used here, including send/recv and link timeouts
+        if (!(params.features & IORING_FEAT_FAST_POLL))
+            goto exitFalse;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe *)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+            goto exitFalse;
+
+        sqEntries = params.sq_entries;
+        sqHead = (unsigned int *)((char *)sqRing + params.sq_off.head);
+        sqTail = (unsigned int *)((char *)sqRing + params.sq_off.tail);
+        sqMask = (unsigned int *)((char *)sqRing + params.sq_off.ring_mask);
+        sqFlags = (unsigned int *)((char *)sqRing + params.sq_off.flags);
+        sqArray = (unsigned int *)((char *)sqRing + params.sq_off.array);
+        cqHead = (unsigned int *)((char *)cqRing + params.cq_off.head);
+        cqTail = (unsigned int *)((char *)cqRing + params.cq_off.tail);
+        cqMask = (unsigned int *)((char *)cqRing + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe *)((char *)cqRing + params.cq_off.cqes);
+        sqLocalTail = *sqTail;
+
+        if ((eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            goto exitFalse;
+
+        if (io_uring_register(ringFd, IORING_REGISTER_EVENTFD, &eventFd, 1) != 0)
+            goto exitFalse;
+
+        watcher = new EVWatcher(Callback_Complete, nullptr);
+        if (watcher->Watch(eventFd, EV_READ | EV_PERSIST, 0) != 0)
+            goto exitFalse;
+
+        HSLL_LOGINFO(LOG_LEVEL_INFO, "io_uring backend enabled, entries: ", sqEntries, sqPoll ? " (SQPOLL)" : "")
+        return true;
+
+    exitFalse:
+        Release();
+        return false;
+    }
+
+    bool URing::InitThreads(unsigned int count, CompleteProc cp)
+    {
+        if (ringFd != -1 || !threads.empty() || count == 0 || cp == nullptr)
+            return false;
+
+        URing::cp = cp;
+
+        if ((eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            goto exitFalse;
+
+        watcher = new EVWatcher(Callback_Complete, nullptr);
+        if (watcher->Watch(eventFd, EV_READ | EV_PERSIST, 0) != 0)
+            goto exitFalse;
+
+        stopping = false;
+        for (unsigned int i = 0; i < count; ++i)
+            threads.emplace_back(Serve);
+
+        HSLL_LOGINFO(LOG_LEVEL_INFO, "File I/O helper threads enabled, threads: ", count)
+        return true;
+
+    exitFalse:
+        Release();
+        return false;
+    }
+
+    void URing::Release()
+    {
+        if (!threads.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(threadMtx);
+                stopping = true;
+            }
+            queueCv.notify_all();
+
+            for (auto &thread : threads)
+                thread.join();
+            threads.clear();
+            queued.clear();
+            served.clear();
+        }
+
+        if (watcher)
+        {
+            delete watcher;
+            watcher = nullptr;
+        }
+
+        backlog.clear();
+        if (sqes != nullptr && (void *)sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        sqes = nullptr;
+        cqRing = sqRing = MAP_FAILED;
+
+        if (eventFd != -1)
+        {
+            close(eventFd);
+            eventFd = -1;
+        }
+
+        if (ringFd != -1)
+        {
+            close(ringFd);
+            ringFd = -1;
+        }
+    }
+
+    bool URing::Enabled()
+    {
+        return ringFd != -1;
+    }
+
+    bool URing::Pending(const URingRequest &req)
+    {
+        int state = req.state.load(std::memory_order_acquire);
+        return state == URING_STATE_STAGED || state == URING_STATE_INFLIGHT;
+    }
+
+    bool URing::Done(const URingRequest &req)
+    {
+        return req.state.load(std::memory_order_acquire) == URING_STATE_DONE;
+    }
+
+    void URing::Discard(URingRequest &req)
+    {
+        int done = URING_STATE_DONE;
+        req.state.compare_exchange_strong(done, URING_STATE_IDLE);
+    }
+
+    io_uring_sqe *URing::GetSqe()
+    {
+        unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+        if (sqLocalTail - head >= sqEntries)
+            return nullptr;
+
+        io_uring_sqe *sqe = &sqes[sqLocalTail & *sqMask];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        sqArray[sqLocalTail & *sqMask] = sqLocalTail & *sqMask;
+        ++sqLocalTail;
+        return sqe;
+    }
+
+    void URing::Publish()
+    {
+        // Entries are filled behind sqLocalTail; hand them to the kernel with a single tail store
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+        if (sqPoll)
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+                io_uring_enter(ringFd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        else
+        {
+            io_uring_enter(ringFd, sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE), 0, 0);
+        }
+    }
+
+    bool URing::Submit(URingRequest &req)
+    {
+        int state = req.state.load(std::memory_order_acquire);
+        if (state != URING_STATE_STAGED)
+            return state == URING_STATE_INFLIGHT;
+
+        if (ringFd == -1)
+        {
+            if (threads.empty())
+                return false;
+
+            // Marked in flight before a helper thread can see it, so its completion is never overwritten
+            req.state.store(URING_STATE_INFLIGHT, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(threadMtx);
+                queued.push_back(&req);
+            }
+            queueCv.notify_one();
+            return true;
+        }
+
+        // A full queue is not an error: the request waits in the backlog until completions make room
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!backlog.empty() || sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) + 2 > sqEntries)
+        {
+            req.state.store(URING_STATE_INFLIGHT, std::memory_order_release);
+            backlog.push_back(&req);
+            return true;
+        }
+
+        Prepare(req);
+        Publish();
+        return true;
+    }
+
+    void URing::Prepare(URingRequest &req)
+    {
+        io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = req.opcode;
+        sqe->fd = req.fd;
+        sqe->addr = req.addr;
+        sqe->len = req.len;
+        sqe->off = req.offset;
+        sqe->user_data = (unsigned long long)&req;
+        if (req.opcode == IORING_OP_SEND)
+            sqe->msg_flags = MSG_NOSIGNAL;
+
+        // Only socket operations wait on the peer; a slow disk must not abort a transfer to a healthy client
+        bool network = (req.opcode == IORING_OP_SEND || req.opcode == IORING_OP_RECV ||
+                        req.opcode == IORING_OP_ACCEPT || req.opcode == IORING_OP_CONNECT);
+        if (seconds && network)
+        {
+            sqe->flags = IOSQE_IO_LINK;
+            req.timeout.tv_sec = seconds;
+            req.timeout.tv_nsec = 0;
+
+            io_uring_sqe *timeout = GetSqe();
+            timeout->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout->fd = -1;
+            timeout->addr = (unsigned long long)&req.timeout;
+            timeout->len = 1;
+            timeout->user_data = 0;
+        }
+
+        req.state.store(URING_STATE_INFLIGHT, std::memory_order_release);
+    }
+
+    void URing::Resubmit()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (backlog.empty())
+            return;
+
+        while (!backlog.empty() && sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) + 2 <= sqEntries)
+        {
+            Prepare(*backlog.front());
+            backlog.pop_front();
+        }
+        Publish();
+    }
+
+    void URing::Cancel(URingRequest &req)
+    {
+        req.ctx = nullptr;
+
+        if (req.state.load(std::memory_order_acquire) != URING_STATE_INFLIGHT)
+        {
+            req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+            return;
+        }
+
+        if (ringFd == -1)
+        {
+            // A queued request is simply dropped; a running one is waited for, it is a bounded file operation
+            std::unique_lock<std::mutex> lock(threadMtx);
+            auto it = std::find(queued.begin(), queued.end(), &req);
+            if (it != queued.end())
+            {
+                queued.erase(it);
+            }
+            else
+            {
+                serveCv.wait(lock, [&req]
+                             { return std::find(served.begin(), served.end(), &req) != served.end(); });
+                served.erase(std::find(served.begin(), served.end(), &req));
+            }
+
+            req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+
+            // A backlogged request never reached the kernel
+            auto it = std::find(backlog.begin(), backlog.end(), &req);
+            if (it != backlog.end())
+            {
+                backlog.erase(it);
+                req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+                return;
+            }
+
+            io_uring_sqe *sqe = GetSqe();
+            if (sqe)
+            {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = -1;
+                sqe->addr = (unsigned long long)&req;
+                sqe->user_data = 0;
+                Publish();
+            }
+        }
+
+        while (req.state.load(std::memory_order_acquire) == URING_STATE_INFLIGHT)
+        {
+            if (io_uring_enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                break;
+            Reap();
+        }
+    }
+
+    void URing::Reap()
+    {
+        unsigned int head = *cqHead;
+        unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+        while (head != tail)
+        {
+            io_uring_cqe *cqe = &cqes[head & *cqMask];
+            URingRequest *req = (URingRequest *)cqe->user_data;
+
+            if (req)
+            {
+                req->result = cqe->res;
+                req->state.store(URING_STATE_DONE, std::memory_order_release);
+                if (req->ctx)
+                    cp(req->ctx);
+            }
+
+            ++head;
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        Resubmit();
+    }
+
+    void URing::ReapServed()
+    {
+        std::vector<URingRequest *> completed;
+        {
+            std::lock_guard<std::mutex> lock(threadMtx);
+            completed.swap(served);
+        }
+
+        for (URingRequest *req : completed)
+        {
+            req->state.store(URING_STATE_DONE, std::memory_order_release);
+            if (req->ctx)
+                cp(req->ctx);
+        }
+    }
+
+    void URing::Serve()
+    {
+        std::unique_lock<std::mutex> lock(threadMtx);
+
+        while (true)
+        {
+            queueCv.wait(lock, []
+                         { return stopping || !queued.empty(); });
+            if (queued.empty())
+                return;
+
+            URingRequest *req = queued.front();
+            queued.pop_front();
+            lock.unlock();
+
+            ssize_t ret;
+            if (req->opcode == IORING_OP_READ)
+                ret = pread(req->fd, (void *)req->addr, req->len, (off_t)req->offset);
+            else
+                ret = pwrite(req->fd, (const void *)req->addr, req->len, (off_t)req->offset);
+            req->result = (ret < 0) ? -errno : (int)ret;
+
+            lock.lock();
+            served.push_back(req);
+            serveCv.notify_all();
+            eventfd_write(eventFd, 1);
+        }
+    }
+
+    void URing::Callback_Complete(void *, short)
+    {
+        eventfd_t value;
+        eventfd_read(eventFd, &value);
+
+        if (ringFd != -1)
+            Reap();
+        else
+            ReapServed();
+    }
+
+    ssize_t URing::Issue(URingRequest &req, unsigned char opcode, int fd,
+                         unsigned long long addr, unsigned int len, unsigned long long offset)
+    {
+        int state = req.state.load(std::memory_order_acquire);
+
+        if (state == URING_STATE_DONE)
+        {
+            req.state.store(URING_STATE_IDLE, std::memory_order_relaxed);
+            if (req.result < 0)
+            {
+                errno = -req.result;
+                return -1;
+            }
+            return req.result;
+        }
+
+        if (state == URING_STATE_IDLE)
+        {
+            req.opcode = opcode;
+            req.fd = fd;
+            req.addr = addr;
+            req.len = len;
+            req.offset = offset;
+            req.state.store(URING_STATE_STAGED, std::memory_order_release);
+        }
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    ssize_t URing::Read(URingRequest &req, int fd, void *buf, size_t len, off_t offset)
+    {
+        if (ringFd == -1 && threads.empty())
+            return pread(fd, buf, len, offset);
+        return Issue(req, IORING_OP_READ, fd, (unsigned long long)buf, (unsigned int)len, (unsigned long long)offset);
+    }
+
+    ssize_t URing::Write(URingRequest &req, int fd, const void *buf, size_t len, off_t offset)
+    {
+        if (ringFd == -1 && threads.empty())
+            return pwrite(fd, buf, len, offset);
+        return Issue(req, IORING_OP_WRITE, fd, (unsigned long long)buf, (unsigned int)len, (unsigned long long)offset);
+    }
+
+    ssize_t URing::Send(URingRequest &req, int fd, const void *buf, size_t len)
+    {
+        if (ringFd == -1)
+            return send(fd, buf, len, 0);
+        return Issue(req, IORING_OP_SEND, fd, (unsigned long long)buf, (unsigned int)len, 0);
+    }
+
+    ssize_t URing::Recv(URingRequest &req, int fd, void *buf, size_t len)
+    {
+        if (ringFd == -1)
+            return recv(fd, buf, len, 0);
+        return Issue(req, IORING_OP_RECV, fd, (unsigned long long)buf, (unsigned int)len, 0);
+    }
+
+    int URing::Accept(URingRequest &req, int fd)
+    {
+        if (ringFd == -1)
+            return accept(fd, nullptr, nullptr);
+        return (int)Issue(req, IORING_OP_ACCEPT, fd, 0, 0, 0);
+    }
+
+    int URing::Connect(URingRequest &req, int fd, const sockaddr_in *addr)
+    {
+        if (ringFd == -1)
+            return connect(fd, (const sockaddr *)addr, sizeof(sockaddr_in));
+
+        if (req.state.load(std::memory_order_acquire) == URING_STATE_IDLE)
+            req.peer = *addr;
+        return (int)Issue(req, IORING_OP_CONNECT, fd, (unsigned long long)&req.peer, 0, sizeof(sockaddr_in));
+    }
+}
@@ -0,0 +1,226 @@
+#ifndef HSLL_URING
+#define HSLL_URING
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include "../Event/Eventcplus.h"
+
+namespace HSLL
+{
+    typedef void (*CompleteProc)(void *ctx); //!< Request completion callback
+
+    /// Request slot state
+    enum URING_STATE
+    {
+        URING_STATE_IDLE,     //!< No operation
+        URING_STATE_STAGED,   //!< Prepared by the coroutine, not yet submitted
+        URING_STATE_INFLIGHT, //!< Submitted, completion not yet reaped
+        URING_STATE_DONE      //!< Completed, result not yet consumed
+    };
+
+    /**
+     * @brief Per-session io_uring request slot
+     * @details A slot holds at most one operation. An operation is staged by the coroutine,
+     *          submitted once the coroutine has suspended (or right away when it overlaps other
+     *          work), and its result is consumed by repeating the same call after it completed
+     */
+    struct URingRequest
+    {
+        void *ctx;                 //!< Owner passed to the completion callback
+        std::atomic<int> state;    //!< URING_STATE of the slot
+        int result;                //!< Completion result (bytes or descriptor, -errno on failure)
+        unsigned char opcode;      //!< Staged operation
+        int fd;                    //!< Staged target descriptor
+        unsigned long long addr;   //!< Staged buffer or address pointer
+        unsigned int len;          //!< Staged length
+        unsigned long long offset; //!< Staged file offset (or address length for connect)
+        sockaddr_in peer;          //!< Connect target, kept alive until completion
+        __kernel_timespec timeout; //!< Link timeout, kept alive until submission
+
+        /**
+         * @brief Constructor
+         * @param ctx Owner passed to the completion callback
+         */
+        explicit URingRequest(void *ctx);
+    };
+
+    /**
+     * @brief io_uring transfer backend for data connections
+     * @details Operations of all sessions are queued on one shared ring (SQPOLL when the kernel
+     *          allows it, so submission needs no syscall while the poller is awake). Completions are
+     *          signalled through an eventfd and reaped on the event loop thread, which serializes them
+     *          with session teardown. Without a ring, file reads and writes can be handed to helper
+     *          threads (InitThreads) that complete through the same eventfd; every other operation
+     *          falls back to the equivalent synchronous syscall
+     */
+    class URing
+    {
+    private:
+        static int ringFd;               //!< io_uring instance, -1 when disabled
+        static int eventFd;              //!< Completion notification descriptor
+        static unsigned int seconds;     //!< Timeout of network operations in seconds, 0 for none
+        static unsigned int sqEntries;   //!< Submission queue size
+        static unsigned int sqLocalTail; //!< Tail of filled but unpublished entries
+        static unsigned int *sqHead;     //!< Submission queue head (kernel owned)
+        static unsigned int *sqTail;     //!< Submission queue tail
+        static unsigned int *sqMask;     //!< Submission queue index mask
+        static unsigned int *sqFlags;    //!< Submission queue flags (SQPOLL wakeup)
+        static unsigned int *sqArray;    //!< Submission queue index array
+        static unsigned int *cqHead;     //!< Completion queue head
+        static unsigned int *cqTail;     //!< Completion queue tail (kernel owned)
+        static unsigned int *cqMask;     //!< Completion queue index mask
+        static io_uring_sqe *sqes;       //!< Submission queue entries
+        static io_uring_cqe *cqes;       //!< Completion queue entries
+        static void *sqRing;             //!< Mapped submission ring
+        static void *cqRing;             //!< Mapped completion ring
+        static size_t sqRingSize;        //!< Mapped submission ring size
+        static size_t cqRingSize;        //!< Mapped completion ring size
+        static size_t sqesSize;          //!< Mapped entries size
+        static bool sqPoll;              //!< Whether a kernel thread polls the submission queue
+        static std::mutex mtx;           //!< Protects the submission queue
+        static CompleteProc cp;          //!< Completion callback
+        static EVWatcher *watcher;       //!< Watches the completion eventfd
+
+        static std::deque<URingRequest *> backlog; //!< Requests waiting for room in the submission queue (under mtx)
+        static std::vector<std::thread> threads;   //!< File I/O helper threads (ring disabled)
+        static std::deque<URingRequest *> queued;  //!< Requests waiting for a helper thread
+        static std::vector<URingRequest *> served; //!< Requests completed by helper threads, not yet reaped
+        static std::mutex threadMtx;               //!< Protects queued, served and stopping
+        static std::condition_variable queueCv;    //!< Signals queued requests
+        static std::condition_variable serveCv;    //!< Signals served requests
+        static bool stopping;                      //!< Helper threads are asked to exit
+
+        /**
+         * @brief Get a free, zeroed submission entry (caller holds mtx)
+         * @return Entry pointer, or nullptr if the queue is full
+         */
+        static io_uring_sqe *GetSqe();
+
+        /**
+         * @brief Make filled entries visible to the kernel and kick it (caller holds mtx)
+         */
+        static void Publish();
+
+        /**
+         * @brief Fill the submission entries of a request and mark it in flight (caller holds mtx)
+         * @note The queue must have room for the request and its link timeout
+         */
+        static void Prepare(URingRequest &req);
+
+        /**
+         * @brief Submit backlogged requests the queue has room for again
+         */
+        static void Resubmit();
+
+        /**
+         * @brief Reap all available completions and dispatch their owners
+         */
+        static void Reap();
+
+        /**
+         * @brief Dispatch the owners of requests completed by helper threads
+         */
+        static void ReapServed();
+
+        /**
+         * @brief Helper thread body, runs queued file reads and writes
+         */
+        static void Serve();
+
+        /**
+         * @brief Event loop callback for the completion eventfd
+         * @param ctx Unused
+         * @param events Triggered event flags
+         */
+        static void Callback_Complete(void *ctx, short events);
+
+        /**
+         * @brief Stage an operation or consume its completed result
+         * @return Result of the operation, or -1 with errno EAGAIN while it is pending
+         */
+        static ssize_t Issue(URingRequest &req, unsigned char opcode, int fd,
+                             unsigned long long addr, unsigned int len, unsigned long long offset);
+
+    public:
+        /**
+         * @brief Initialize the shared ring
+         * @param entries Submission queue size
+         * @param seconds Timeout of socket operations in seconds, 0 for none; file I/O is never timed out
+         * @param cp Callback invoked on the event loop thread when a request completes
+         * @return true on success, false if io_uring is unavailable (synchronous fallback stays active)
+         * @note EVSocket must be constructed first
+         */
+        static bool Init(unsigned int entries, unsigned int seconds, CompleteProc cp);
+
+        /**
+         * @brief Start helper threads that run file reads and writes asynchronously
+         * @param count Number of helper threads
+         * @param cp Callback invoked on the event loop thread when a request completes
+         * @return true on success, false if not started (the ring is active or setup failed)
+         * @note EVSocket must be constructed first
+         */
+        static bool InitThreads(unsigned int count, CompleteProc cp);
+
+        /**
+         * @brief Release the ring and helper threads, falling back to synchronous operations
+         */
+        static void Release();
+
+        /**
+         * @brief Check whether the io_uring backend is active
+         * @return true if operations are submitted to the ring
+         */
+        static bool Enabled();
+
+        /**
+         * @brief Check whether a request is staged or in flight
+         * @param req Request slot
+         * @return true if a completion is still expected
+         */
+        static bool Pending(const URingRequest &req);
+
+        /**
+         * @brief Check whether a request has completed and its result is not yet consumed
+         * @param req Request slot
+         * @return true if the result is ready
+         */
+        static bool Done(const URingRequest &req);
+
+        /**
+         * @brief Submit the staged operation of a request
+         * @param req Request slot
+         * @return true if the operation is in flight, false if nothing was staged
+         * @note When the submission queue is full the request waits in flight until completions free room
+         */
+        static bool Submit(URingRequest &req);
+
+        /**
+         * @brief Drop a completed result that will not be consumed
+         * @param req Request slot, must not be pending
+         */
+        static void Discard(URingRequest &req);
+
+        /**
+         * @brief Cancel an outstanding request and wait until the kernel or helper thread releases it
+         * @param req Request slot
+         * @note Must be called on the event loop thread
+         */
+        static void Cancel(URingRequest &req);
+
+        static ssize_t Read(URingRequest &req, int fd, void *buf, size_t len, off_t offset);        //!< pread()
+        static ssize_t Write(URingRequest &req, int fd, const void *buf, size_t len, off_t offset); //!< pwrite()
+        static ssize_t Send(URingRequest &req, int fd, const void *buf, size_t len);                //!< send()
+        static ssize_t Recv(URingRequest &req, int fd, void *buf, size_t len);                      //!< recv()
+        static int Accept(URingRequest &req, int fd);                                               //!< accept()
+        static int Connect(URingRequest &req, int fd, const sockaddr_in *addr);                     //!< connect()
+    };
+}
+
+#endif